@@ -0,0 +1,57 @@
+/*==============================================================================
+    Copyright (c) 2010 Colin Rundel
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file BOOST_LICENSE_1_0.rst or copy at http://www.boost.org/LICENSE_1_0.txt)
+==============================================================================*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include <parse/parse_tree.hpp>
+
+namespace carto {
+
+// On-disk cache of compiler output. Parse trees are stored under the hash
+// of their source text, compiled maps under the hash of the input path in
+// one file that starts with a manifest of every file they were built from,
+// so a map entry is only reused while none of its inputs have changed. All
+// keys include the compiler and mapnik versions.
+class compile_cache {
+
+public:
+    explicit compile_cache(std::string const& dir_);
+
+    static std::string hash(char const* begin, char const* end);
+    static std::string hash(std::string const& str);
+    static std::string hash_file(std::string const& filename);
+
+    // trees come back without the line index of their source, which the
+    // caller rebuilds from the text it hashed
+    boost::optional<parse_tree> load_tree(std::string const& key) const;
+    void store_tree(std::string const& key, parse_tree const& pt) const;
+
+    boost::optional<std::string> load_map(std::string const& input, std::string const& options = "") const;
+    // hashes holds the hash of the text each of deps was compiled from, as
+    // it was read rather than as it is on disk now
+    void store_map(std::string const& input, std::vector<std::string> const& deps,
+                   std::vector<std::string> const& hashes,
+                   std::string const& xml, std::string const& options = "") const;
+
+private:
+    std::string entry(std::string const& prefix, std::string const& key,
+                      std::string const& ext) const;
+    std::string map_key(std::string const& input, std::string const& options) const;
+    void write_file(std::string const& filename, std::string const& data) const;
+
+    std::string dir;
+};
+
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef CASCADE_H
+#define CASCADE_H
+
+#include <string>
+#include <vector>
+
+#include <boost/spirit/include/support_utree.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <property_table.hpp>
+#include <rule_builder.hpp>
+#include <generate/filter_chain.hpp>
+
+#include <utility/source_location.hpp>
+
+namespace carto {
+
+// Ids, classes and filters of a selector, then its position in the
+// stylesheet. Of two declarations of the same property the one with the
+// greater specificity wins.
+struct specificity {
+    unsigned ids;
+    unsigned classes;
+    unsigned filters;
+    unsigned index;
+
+    specificity();
+
+    // ids and classes are counted from the style name, attachment excluded
+    specificity(std::string const& style_name, unsigned filters_, unsigned index_);
+
+    bool operator<(specificity const& other) const;
+};
+
+// A style property with its value evaluated where it was declared.
+struct declaration {
+    property const* prop;
+    boost::spirit::utree value;
+
+    // the value is evaluated and has no location of its own
+    source_location loc;
+
+    declaration(property const* prop_, boost::spirit::utree const& value_, source_location const& loc_)
+      : prop(prop_), value(value_), loc(loc_) { }
+};
+
+// One selector of a style block: its filter, the scale denominators of its
+// rule, the number of filters it was selected by including those of the
+// blocks it is nested in, its declarations in source order and the
+// symbolizers they build, which are applied once, as they are parsed. The
+// filter is set on the rule when the definition is resolved.
+struct definition {
+    filter_chain filter;
+    rule_builder rule;
+    unsigned filters;
+    specificity spec;
+    std::vector<declaration> declarations;
+    rule_builder symbolizers;
+
+    definition()
+      : filter(), rule(), filters(0), spec(), declarations(), symbolizers() { }
+};
+
+// Resolves the definitions of each style into the rules it is rendered
+// with. Definitions with the same filter and scale range are merged into
+// one rule, and a rule also takes the declarations of every rule whose
+// conditions are a subset of its own and whose scale range holds its own,
+// i.e. which matches all features it matches. The scale range of a rule is
+// first split at the bounds of the rules with a subset of its conditions,
+// so #a[x=1] and #a[zoom>=12] give a rule for [x]=1 from zoom 12 on with
+// the declarations of both. Declarations are applied in order of
+// specificity so the most specific one of each property wins. The rules
+// are for styles that render the first rule a feature matches, so each
+// comes out before the rules broader than it and otherwise most specific
+// first.
+//
+// Definitions are grouped by hashing their filters, and the broader rules
+// of a rule are found by looking up the subsets of its conditions, so
+// resolving takes time linear in the number of definitions for filters of
+// a few conditions each. Rules whose filters merely overlap, like [x]=1 and
+// [y]=2, are not intersected; a feature matching both gets the more
+// specific one.
+class cascade {
+
+public:
+    struct resolved_rule {
+        rule_builder rule;
+        std::vector<declaration const*> declarations;
+
+        // the definitions the declarations come from, least specific first
+        std::vector<definition const*> sources;
+
+        // the and-ed conditions of the filter, sorted
+        std::vector<std::string> terms;
+    };
+
+    void add(std::string const& style, definition const& def);
+
+    std::vector<std::string> const& styles() const;
+
+    void resolve(std::string const& style, std::vector<resolved_rule>& rules) const;
+
+    // Shortens the resolved rules of a style without changing what any
+    // feature is rendered with: rules without declarations, with an empty
+    // scale range or a filter that is always false are dropped, and a rule
+    // with the same conditions and declarations as the one before it and a
+    // scale range that meets its range is merged into it. The rules must be
+    // in the order resolve puts them in, narrower first; then only a merged
+    // rule can match every feature of a rule after it, which is dropped as
+    // it can never be reached. Declarations are compared instead of the
+    // symbolizers they build, which mapnik cannot compare.
+    static void compact(std::vector<resolved_rule>& rules);
+
+    void clear();
+
+private:
+    typedef boost::unordered_map< std::string, std::vector<definition> > definition_map;
+
+    definition_map definitions_;
+    std::vector<std::string> styles_;
+};
+
+}
+
+#endif
@@ -16,6 +16,7 @@
 #include <boost/spirit/include/qi.hpp>
 
 #include <utility/position_iterator.hpp>
+#include <utility/line_index.hpp>
 
 namespace carto {
 
@@ -24,6 +25,10 @@ struct exception : std::exception
 {
     std::string msg;
     
+    std::string source;
+    source_location loc;
+    std::string detail;
+    
     exception ();
     
     exception (std::string const& source, source_location loc,
@@ -32,6 +37,10 @@ struct exception : std::exception
     void set (std::string const& source, source_location loc,
               std::string const& exception);
     
+    // attaches the line index of the source to a location taken while 
+    // parsing, which only knows its offset
+    void set_lines (boost::shared_ptr<line_index const> const& lines);
+    
     const char* what () const throw();
     
     ~exception () throw();
@@ -6,6 +6,7 @@
 #include <utility/utree.hpp>
 #include <utility/environment.hpp>
 #include <utility/carto_functions.hpp>
+#include <utility/color.hpp>
 
 #include <parse/expression_grammar.hpp>
 
@@ -26,17 +27,17 @@ struct expression {
     
     inline int get_node_type(utree const& ut)
     {   
-        return annotations[ut.tag()].second;
+        return annotations.type(ut);
     }
 
     inline source_location get_location(utree const& ut)
     {    
-        return annotations[ut.tag()].first;
+        return annotations.location(ut);
     }
 
     inline bool is_color(utree const& ut)
     {
-        return get_node_type(ut) == CARTO_EXP_COLOR;
+        return carto::is_color(ut);
     }
     
     inline bool is_double(utree const& ut)
@@ -49,57 +50,46 @@ struct expression {
         return eval_node(tree);
     }
 
-    utree eval_var(utree const& node);
+    utree eval_var(utree const& node, source_location const& loc);
     
     utree eval_node(utree const& node);
     
     utree eval_function(utree const& node);
-    
-    utree fix_color_range(utree const& node);
 
 #define EVAL_OP(name, op)                                                            \
     utree eval_##name(utree const& lhs, utree const& rhs)                            \
     {                                                                                \
-        typedef utree::const_iterator iter;                                          \
         utree ut;                                                                    \
                                                                                      \
         if ( is_color(lhs) && is_color(rhs) ) {                                      \
-            BOOST_ASSERT(lhs.size()==rhs.size());                                    \
-            BOOST_ASSERT(lhs.size()==4);                                             \
-                                                                                     \
-            iter lhs_it  = lhs.begin(),                                              \
-                 rhs_it  = rhs.begin();                                              \
+            mapnik::color l = as<mapnik::color>(lhs),                                \
+                          r = as<mapnik::color>(rhs);                                \
                                                                                      \
+            ut = make_color( fmod(double(l.red())   op r.red(),   256),              \
+                             fmod(double(l.green()) op r.green(), 256),              \
+                             fmod(double(l.blue())  op r.blue(),  256),              \
+                             (double(l.alpha()) + r.alpha()) / 2 );                  \
             ut.tag(lhs.tag());                                                       \
-            for(int i = 0; i != 3; i++, lhs_it++, rhs_it++) {                        \
-                double res = as<double>(*lhs_it) op as<double>(*rhs_it);             \
-                ut.push_back( fmod(res, 256) );                                      \
-            }                                                                        \
-            ut.push_back( (as<double>(*lhs_it) + as<double>(*rhs_it)) / 2 );         \
                                                                                      \
         } else if ( is_double(lhs) && is_color(rhs) ) {                              \
-            BOOST_ASSERT(rhs.size()==4);                                             \
-            iter rhs_it  = rhs.begin();                                              \
+            mapnik::color r = as<mapnik::color>(rhs);                                \
             double d = as<double>(lhs);                                              \
                                                                                      \
+            ut = make_color( fmod(d op r.red(),   256),                              \
+                             fmod(d op r.green(), 256),                              \
+                             fmod(d op r.blue(),  256),                              \
+                             r.alpha() );                                            \
             ut.tag(rhs.tag());                                                       \
-            for(int i = 0; i != 3; i++, rhs_it++) {                                  \
-                double res = d op as<double>(*rhs_it);                               \
-                ut.push_back( fmod(res, 256) );                                      \
-            }                                                                        \
-            ut.push_back( as<double>(*rhs_it) );                                     \
                                                                                      \
         } else if ( is_color(lhs) && is_double(rhs) ) {                              \
-            BOOST_ASSERT(lhs.size()==4);                                             \
-            iter lhs_it  = lhs.begin();                                              \
+            mapnik::color l = as<mapnik::color>(lhs);                                \
             double d = as<double>(rhs);                                              \
                                                                                      \
+            ut = make_color( fmod(d op l.red(),   256),                              \
+                             fmod(d op l.green(), 256),                              \
+                             fmod(d op l.blue(),  256),                              \
+                             l.alpha() );                                            \
             ut.tag(lhs.tag());                                                       \
-            for(int i = 0; i != 3; i++, lhs_it++) {                                  \
-                double res = d op as<double>(*lhs_it);                               \
-                ut.push_back( fmod(res,256) );                                       \
-            }                                                                        \
-            ut.push_back( as<double>(*lhs_it) );                                     \
                                                                                      \
         } else {                                                                     \
             ut = lhs op rhs;                                                         \
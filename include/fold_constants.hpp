@@ -0,0 +1,20 @@
+#ifndef FOLD_CONSTANTS_H
+#define FOLD_CONSTANTS_H
+
+#include <parse/parse_tree.hpp>
+
+namespace carto {
+
+// Evaluates every expression value of a stylesheet that can be computed
+// without a compile time environment and replaces it with the resulting
+// literal, so it is evaluated once per parse instead of once per use. An
+// expression can refer to top level variables of the same stylesheet that
+// are defined exactly once, before the expression, and hold a literal or
+// an expression folded in turn. Expressions that fail to evaluate are left
+// alone, their errors are reported when the stylesheet is compiled.
+// Returns the number of expressions folded.
+std::size_t fold_constants(parse_tree& tree);
+
+}
+
+#endif
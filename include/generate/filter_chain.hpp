@@ -0,0 +1,48 @@
+#ifndef FILTER_CHAIN_H
+#define FILTER_CHAIN_H
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <mapnik/expression_node.hpp>
+
+namespace carto {
+
+// The filter of a nested selector: its own conditions and a link to the
+// chain of the selector it is nested in, which is shared rather than
+// copied, so nesting a selector costs the size of its own filter whatever
+// the depth. The conditions of each level are normalized and split into
+// terms once, when the level is added; the and of the whole chain is only
+// built for the rules that are emitted.
+class filter_chain {
+
+public:
+    filter_chain();
+
+    // the chain of parent with the conditions of one more level
+    filter_chain(filter_chain const& parent, mapnik::expr_node const& conditions);
+
+    bool empty() const;
+
+    // appends the terms of every level, outermost first
+    void terms(std::vector<std::string>& out) const;
+
+    // the normalized and of all levels, true for the empty chain
+    mapnik::expr_node build() const;
+
+private:
+    struct link {
+        boost::shared_ptr<link const> parent;
+        mapnik::expr_node conditions;
+        std::vector<std::string> terms;
+        std::size_t depth;
+    };
+
+    boost::shared_ptr<link const> head_;
+};
+
+}
+
+#endif
@@ -8,53 +8,83 @@
 #ifndef GENERATE_FILTER_H
 #define GENERATE_FILTER_H
 
-#include <iosfwd>
-#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
 
 #include <parse/parse_tree.hpp>
 #include <parse/filter_grammar.hpp>
 
+#include <rule_builder.hpp>
+#include <generate/zoom_table.hpp>
+
 #include <utility/environment.hpp>
 #include <utility/utree.hpp>
 
-#include <mapnik/rule.hpp>
+#include <mapnik/expression_node.hpp>
+#include <mapnik/value.hpp>
 
 namespace carto {
 
+// Builds the mapnik expression for a filter directly from its parse tree.
+// Zoom conditions are not part of the expression, they set the scale
+// denominators of the rule instead and produce no node.
 struct filter_printer {
-    typedef std::string result_type;
+    typedef boost::optional<mapnik::expr_node> result_type;
 
     utree const& tree;
     annotations_type const& annotations;
     style_env const& env;
-    mapnik::rule& rule;
+    rule_builder& rule;
+    zoom_table const& zooms;
 
     filter_printer(utree const& tree_, annotations_type const& annotations_, 
-                   style_env const& env_, mapnik::rule& rule_);
+                   style_env const& env_, rule_builder& rule_,
+                   zoom_table const& zooms_);
     
-    std::string print();
+    result_type generate();
     
     utree parse_var(utree const& ut);
     
     double parse_zoom_value(utree const& ut);
     
-    std::string operator() (utree const& ut);
+    std::string attribute_name(utree const& ut);
+    
+    mapnik::expr_node value(utree const& ut);
+    
+    result_type operator() (utree const& ut);
+    
+    template<class Tag>
+    result_type comparison(utree const& lhs, utree const& rhs);
+};
 
-    template<class T>
-    std::string operator() (T val)
-    {
-        std::stringstream out;
-        out << val;
-        
-        return out.str();
-    }
+// Replace node with the Tag of node and operand, or of operand and node.
+// node is moved into the new node rather than copied, so joining n 
+// operands one at a time takes time linear in their size.
+template<class Tag>
+void append_operand(mapnik::expr_node& node, mapnik::expr_node const& operand)
+{
+    mapnik::expr_node joined = mapnik::binary_node<Tag>(mapnik::value(true), operand);
+    
+    boost::get< mapnik::binary_node<Tag> >(joined).left.swap(node);
+    node.swap(joined);
+}
 
-    std::string operator() (bool b);
+template<class Tag>
+void prepend_operand(mapnik::expr_node& node, mapnik::expr_node const& operand)
+{
+    mapnik::expr_node joined = mapnik::binary_node<Tag>(operand, mapnik::value(true));
+    
+    boost::get< mapnik::binary_node<Tag> >(joined).right.swap(node);
+    node.swap(joined);
+}
 
-    std::string operator() (spirit::utf8_string_range_type const& str);
+bool is_true_filter(mapnik::expr_node const& node);
 
-    std::string operator() (spirit::utf8_symbol_range_type const& str);
-};
+// Appends the conditions a filter requires all of, the operands of its 
+// outermost and-ed nodes, as expression strings. The true filter has none.
+void filter_terms(mapnik::expr_node const& node, std::vector<std::string>& terms);
 
 }
 #endif 
@@ -21,7 +21,7 @@ struct json_printer {
     typedef void result_type;
 
     Out& out;
-    annotations_type annotations;
+    annotations_type const& annotations;
 
     json_printer (Out& out_, annotations_type const& annotations_)
       : out(out_), 
@@ -142,15 +142,15 @@ struct json_printer {
 
             case utree_type::range_type:
             case utree_type::list_type:
-                if (annotations[ut.tag()].second == json_object) {
+                if (annotations.type(ut) == json_object) {
                     print_object(ut);
                     return;
                 }
-                else if (annotations[ut.tag()].second == json_array) {
+                else if (annotations.type(ut) == json_array) {
                     print_array(ut);
                     return;
                 }
-                else if (annotations[ut.tag()].second == json_pair) {
+                else if (annotations.type(ut) == json_pair) {
                     print_member_pair(ut);
                     return;
                 }
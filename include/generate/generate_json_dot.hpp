@@ -21,7 +21,7 @@ struct json_dot_printer {
     typedef void result_type;
 
     Out& out;
-    annotations_type annotations;
+    annotations_type const& annotations;
     int n_id,cur_id;
     std::string prefix;
 
@@ -61,15 +61,15 @@ struct json_dot_printer {
                 
                 int start_id = n_id;
                 
-                if (annotations[ut.tag()].second == json_object) {
+                if (annotations.type(ut) == json_object) {
                     out << prefix << id << " [label=\"[object]\"];\n"; 
                     it    = ut.front().begin();
                     end   = ut.front().end();
                     n_id += ut.front().size();
                 } else {
-                    if (annotations[ut.tag()].second == json_array) {
+                    if (annotations.type(ut) == json_array) {
                         out << prefix << id << " [label=\"[array]\"];\n"; 
-                    } else if (annotations[ut.tag()].second == json_pair) {
+                    } else if (annotations.type(ut) == json_pair) {
                         out << prefix << id << " [label=\"[pair]\"];\n"; 
                     } else {
                         BOOST_ASSERT(false);
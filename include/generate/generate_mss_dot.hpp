@@ -22,7 +22,7 @@ struct mss_dot_printer {
     typedef void result_type;
 
     Out& out;
-    annotations_type annotations;
+    annotations_type const& annotations;
     int n_id,cur_id;
     std::string prefix;
 
@@ -61,9 +61,9 @@ struct mss_dot_printer {
                 iterator it, end;
                 
                 int start_id = n_id;
-                carto_node_type nope_type = annotations[ut.tag()].second;
+                carto_node_type nope_type = annotations.type(ut);
 
-                /*if (annotations[ut.tag()].second == json_object) {
+                /*if (annotations.type(ut) == json_object) {
                     out << prefix << id << " [label=\"[object]\"];\n"; 
                     it    = ut.front().begin();
                     end   = ut.front().end();
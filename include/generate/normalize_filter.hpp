@@ -0,0 +1,23 @@
+#ifndef NORMALIZE_FILTER_H
+#define NORMALIZE_FILTER_H
+
+#include <mapnik/expression_node.hpp>
+
+namespace carto {
+
+// Simplifies a filter without changing which features it matches. Nested
+// and-ed and or-ed nodes are flattened into one list of operands each, in
+// which duplicates are dropped, constant true and false are folded and
+// the cheap comparisons of an attribute with a literal come before regular
+// expressions, so mapnik's short circuit evaluation tries them first. An
+// and of comparisons that no value of an attribute can satisfy at once,
+// e.g. [type]='a' and [type]='b' or [n]>5 and [n]<3, becomes false. A not
+// of a constant or of another not is folded; comparisons are not negated
+// into each other, = and != are both false for a null attribute.
+mapnik::expr_node normalize_filter(mapnik::expr_node const& node);
+
+bool is_false_filter(mapnik::expr_node const& node);
+
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef ZOOM_TABLE_H
+#define ZOOM_TABLE_H
+
+#include <string>
+#include <vector>
+
+namespace carto {
+
+// The scale denominators that bound each zoom level, for turning zoom
+// filters into the scale range of a rule. By default this is the table of
+// rounded values for 256 pixel tiles that carto has always used, with
+// levels 0 to 23; the last level takes every scale below its upper bound.
+// The historic table can be cut short or extended past level 23, where
+// each level halves the scale of the one before.
+// A table for other tile sizes and scale factors is computed from the
+// scale of spherical mercator zoom 0, with the bounds of a level halfway
+// between it and its neighbours on a logarithmic scale.
+class zoom_table {
+
+public:
+    enum { max_levels = 30 };
+
+    zoom_table();
+
+    // the historic table with levels 0 to max_zoom, throws a carto_error
+    // for a max zoom above max_levels
+    explicit zoom_table(unsigned max_zoom);
+
+    // throws a carto_error for a tile size of 0, a scale factor that is
+    // not positive or a max zoom above max_levels
+    zoom_table(unsigned tile_size, double scale_factor, unsigned max_zoom);
+
+    int max_zoom() const;
+
+    // Scale range of the zoom levels first to last, both included and
+    // clamped to the table. Returns false if no level is in range, e.g.
+    // for levels past the max zoom.
+    bool scale_range(int first, int last, double& min_scale, double& max_scale) const;
+
+    // identifies the table for cache keys, empty for the default one
+    std::string const& key() const;
+
+private:
+    std::vector<double> bounds_;
+    std::string key_;
+};
+
+}
+
+#endif
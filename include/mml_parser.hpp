@@ -13,19 +13,42 @@
 
 #include <boost/optional.hpp>
 
+#include <cache.hpp>
+#include <generate/zoom_table.hpp>
 #include <parse/parse_tree.hpp>
 #include <utility/utree.hpp>
+#include <utility/dependencies.hpp>
 
 namespace carto {
 
 namespace al = boost::algorithm;
 
+struct stylesheet {
+    std::string path;
+    std::string source;
+    bool from_file;
+    parse_tree tree;
+    dependency_set deps;
+    
+    // of the text the tree was parsed from
+    std::string hash;
+    
+    // expressions folded when the tree was parsed
+    std::size_t folded;
+};
+
 struct mml_parser {
 
     parse_tree tree;
     bool strict;
     std::string path;
+    
+    // of the text the project was parsed from, empty if it came as a tree
+    std::string hash;
     std::vector< std::vector<std::string> > layer_selectors;
+    std::vector<stylesheet> stylesheets;
+    compile_cache const* cache;
+    zoom_table zooms;
     
     mml_parser(parse_tree  const& pt, std::string const& path_, bool strict_ = false);
     mml_parser(std::string const& in, std::string const& path_, bool strict_ = false);
@@ -33,6 +56,15 @@ struct mml_parser {
     
     parse_tree get_parse_tree();
     std::string get_path();
+    std::vector<std::string> get_dependencies();
+    
+    // the hashes of the text of each dependency as it was read, which may
+    // no longer be what is on disk
+    std::vector<std::string> get_dependency_hashes();
+    std::size_t folded_constants();
+    
+    void set_cache(compile_cache const* cache_);
+    void set_zoom_table(zoom_table const& zooms_);
     
     node_type get_node_type(utree const& ut);
     source_location get_location(utree const& ut);
@@ -42,6 +74,14 @@ struct mml_parser {
     void parse(mapnik::Map& map);
     void parse_map(mapnik::Map& map);
     void parse_stylesheet(mapnik::Map& map, utree const& node);
+    void load_stylesheets();
+    void load_stylesheets(std::vector<bool> const& changed);
+    
+    void recompile(mapnik::Map& map, std::vector<std::string> const& changed);
+    void rebuild(mapnik::Map& map, std::vector<bool> const& dirty);
+    bool close_dependencies(std::vector<bool>& dirty);
+    void attach_styles(mapnik::Map& map);
+    
     void parse_layer(mapnik::Map& map, utree const& node);
     void parse_Datasource(mapnik::layer& lyr, utree const& node);
 
@@ -9,9 +9,15 @@
 #define MSS_PARSER_H
 
 #include <parse/parse_tree.hpp>
+#include <cascade.hpp>
+#include <generate/zoom_table.hpp>
+#include <property_table.hpp>
+#include <rule_builder.hpp>
 
 #include <utility/utree.hpp>
 #include <utility/environment.hpp>
+#include <utility/dependencies.hpp>
+#include <utility/profile.hpp>
 
 #include <boost/utility.hpp>
 #include <boost/variant.hpp>
@@ -29,6 +35,19 @@ private:
     parse_tree tree;
     bool strict;
     std::string path;
+    dependency_set* deps;
+    std::size_t folded;
+    
+    // the definitions of the stylesheet's styles until they are resolved
+    // into rules at the end of parse
+    cascade pending;
+    unsigned definition_count;
+    
+    // set while declarations that already reported their errors are
+    // applied again
+    bool quiet;
+    
+    zoom_table zooms;
     
     boost::unordered_map<std::size_t, std::string> fontset_names;
     mapnik::expression_grammar<std::string::const_iterator> expr_grammar;
@@ -42,27 +61,24 @@ public:
     
     parse_tree get_parse_tree();
     std::string get_path();
+    std::size_t folded_constants();
+    
+    void set_dependencies(dependency_set* deps_);
+    void set_zoom_table(zoom_table const& zooms_);
 
     int get_node_type(utree const& ut);    
     source_location get_location(utree const& ut);
 
     template<class symbolizer>
-    symbolizer* find_symbolizer(mapnik::rule& rule) 
+    symbolizer* find_symbolizer(rule_builder& rule) 
     {
-        typedef mapnik::rule::symbolizers::iterator iter;
-        iter it  = rule.begin(),
-             end = rule.end();
-        
-        for(; it!=end; ++it) {
-            if (symbolizer *sym = boost::get<symbolizer>(&(*it)))
-                return(sym);
-        }
+        if (symbolizer *sym = rule.find<symbolizer>())
+            return(sym);
         
-        BOOST_ASSERT(it==end);
         rule.append(init_symbolizer<symbolizer>());
+        profiler::count(profiler::symbolizers_created);
         
-        symbolizer *sym = boost::get<symbolizer>(& (*(--rule.end())) );
-        return(sym);
+        return(rule.find<symbolizer>());
     }
     
     template<class symbolizer>
@@ -71,33 +87,42 @@ public:
         return symbolizer();
     }
 
-    mapnik::transform_type create_transform(std::string const& str, utree const& node);
+    mapnik::transform_type create_transform(std::string const& str, source_location const& loc);
+    mapnik::expression_ptr parse_expression(std::string const& str);
     
     void key_error(std::string const& key, utree const& node);
+    void key_error(std::string const& key, source_location const& loc);
     
-    utree eval_var(utree const& node, style_env const& env);    
+    utree eval_var(utree const& node, style_env const& env, source_location const& loc);
     utree parse_value(utree const& node, style_env const& env);
     void parse_variable(utree const& node, style_env& env);
 
     void parse(mapnik::Map& map, style_env& env);
+    void parse_definitions(mapnik::Map& map, style_env& env);
     void parse_stylesheet(mapnik::Map& map, style_env& env);
     void parse_map_style(mapnik::Map& map, utree const& node, style_env& env);
     void parse_style(mapnik::Map& map, utree const& node, style_env const& parent_env, 
-                     mapnik::rule const& parent_rule = mapnik::rule(), std::string const& parent_name = "");
-    void parse_filter(mapnik::Map& map, utree const& node, style_env const& env, mapnik::rule& rule);
-    void parse_attribute(mapnik::Map& map, utree const& node, style_env const& env, mapnik::rule& rule);
+                     definition const& parent = definition(), std::string const& parent_name = "");
+    void parse_filter(mapnik::Map& map, utree const& node, style_env const& env, definition& def);
+    void parse_attribute(mapnik::Map& map, utree const& node, style_env const& env, definition& def);
+    void apply_declaration(mapnik::Map& map, declaration const& decl, rule_builder& rule);
+    void emit_styles(mapnik::Map& map);
     
-    bool parse_polygon(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env);
-    bool parse_line(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env);
-    bool parse_marker(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env);
-    bool parse_point(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env);
-    bool parse_line_pattern(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env);
-    bool parse_polygon_pattern(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env);
-    bool parse_raster(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env);
-    bool parse_building(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env);
-    bool parse_text(mapnik::Map& map, mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env);
-    bool parse_shield(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env);    
+    bool parse_polygon(rule_builder& rule, property_type prop, utree const& value);
+    bool parse_line(rule_builder& rule, property_type prop, utree const& value);
+    bool parse_marker(rule_builder& rule, property_type prop, utree const& value, source_location const& loc);
+    bool parse_point(rule_builder& rule, property_type prop, utree const& value, source_location const& loc);
+    bool parse_line_pattern(rule_builder& rule, property_type prop, utree const& value);
+    bool parse_polygon_pattern(rule_builder& rule, property_type prop, utree const& value);
+    bool parse_raster(rule_builder& rule, property_type prop, utree const& value, source_location const& loc);
+    bool parse_building(rule_builder& rule, property_type prop, utree const& value);
+    bool parse_text(mapnik::Map& map, rule_builder& rule, property_type prop, utree const& value);
+    bool parse_shield(rule_builder& rule, property_type prop, utree const& value);    
 };
 
+parse_tree parse_mss(std::string const& filename);
+parse_tree parse_mss(boost::iterator_range<char const*> const& in, std::string const& path);
+parse_tree parse_mss_string(std::string const& in, std::string const& path);
+
 }
 #endif 
@@ -0,0 +1,130 @@
+/*==============================================================================
+    Copyright (c) 2010 Bryce Lelbach
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file BOOST_LICENSE_1_0.rst or copy at http://www.boost.org/LICENSE_1_0.txt)
+==============================================================================*/
+
+#ifndef ANNOTATION_TABLE_H
+#define ANNOTATION_TABLE_H
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/spirit/include/support_utree.hpp>
+
+#include <utility/source_location.hpp>
+#include <utility/line_index.hpp>
+#include <utility/symbol_table.hpp>
+
+namespace carto {
+
+using boost::spirit::utree;
+
+// Source location and node type of every annotated node in a parse tree.
+//
+// Locations are kept as byte offsets into the source and come back from
+// location() with the line index of the source attached, which turns them
+// into lines and columns when they are printed.
+//
+// While parsing, annotations are appended column-wise to fixed size blocks 
+// and each node's utree::tag() holds the low 16 bits of its entry's index. 
+// Annotations are pushed as rules complete, so the surviving nodes visited 
+// in post-order have increasing indices and finalize() can recover the full
+// index of every node however large the tree is, as long as no more than a
+// tag range of discarded (backtracked) annotations falls between two nodes;
+// finalize() throws if that cannot be ruled out. It then rewrites each tag
+// to the node's type and moves the locations into a table keyed by node 
+// address. Nodes that are not part of the tree (e.g. copies made during 
+// evaluation) keep their type but have no location, so the code that copies
+// a node out of the tree keeps its location alongside, as variable bindings
+// and declarations do.
+//
+// finalize() also interns the variable names the grammars push with
+// name_flag and stores each one's symbol id in the bits of its tag above 
+// the type, so looking a variable up needs neither the symbol table nor its
+// lock. Ids that don't fit are left out and those names are interned when
+// they are used.
+class annotation_table : private boost::noncopyable {
+
+public:
+    annotation_table();
+    ~annotation_table();
+
+    // parse time interface
+    enum { name_flag = 1 << 8 };
+
+    std::size_t push(source_location const& loc, int type);
+    static short tag(std::size_t index);
+
+    void reserve(std::size_t n);
+    void finalize(utree& ast);
+
+    // rough number of annotated nodes produced per byte of input
+    static std::size_t estimate(std::size_t input_size);
+
+    // lookups, valid once finalized
+    int type(utree const& ut) const;
+
+    // the symbol id stored on a name by finalize() or restore()
+    static bool symbol(utree const& ut, symbol_id& id);
+    source_location location(utree const& ut) const;
+
+    std::size_t size() const;
+    void clear();
+
+    // line index of the source the offsets point into
+    boost::shared_ptr<line_index const> const& lines() const;
+    void set_lines(boost::shared_ptr<line_index const> const& lines);
+
+    // offsets of the annotated nodes in post-order, and the reverse
+    std::vector<boost::uint32_t> offsets(utree const& ast) const;
+    void restore(utree& ast, std::vector<boost::uint32_t> const& offsets);
+
+    // drops the locations of every node in the given subtrees, for passes 
+    // that are about to replace them in place
+    void erase(std::vector<utree const*> const& roots);
+
+    // gives a node that replaced an annotated one in place, at the same 
+    // address, a type; it keeps the location of the node it replaced
+    void set_type(utree& ut, int type) const;
+
+private:
+    friend struct annotation_table_finalizer;
+    friend struct annotation_table_restorer;
+    friend struct annotation_table_eraser;
+
+    enum { block_bits = 10, block_size = 1 << block_bits };
+
+    struct block {
+        boost::uint32_t offset[block_size];
+        int type[block_size];
+    };
+
+    struct node_location {
+        utree const* node;
+        boost::uint32_t offset;
+
+        bool operator< (node_location const& other) const
+        {
+            return node < other.node;
+        }
+    };
+
+    std::size_t append(source_location const& loc, int type);
+    void release_blocks();
+
+    std::vector<block*> blocks_;
+    std::size_t pushed_;
+
+    std::vector<node_location> index_;
+    boost::shared_ptr<line_index const> lines_;
+};
+
+typedef annotation_table annotations_type;
+
+}
+
+#endif
@@ -9,18 +9,15 @@
 #ifndef ANNOTATOR_H
 #define ANNOTATOR_H
 
-#include <limits>
-
 #include <boost/spirit/include/qi.hpp>
 #include <boost/spirit/include/phoenix.hpp>
 
 #include <utility/utree.hpp>
 #include <utility/position_iterator.hpp>
 
-namespace carto {
+#include <parse/annotation_table.hpp>
 
-typedef std::pair<source_location, int> annotation_type;
-typedef std::vector< annotation_type > annotations_type;
+namespace carto {
 
 namespace qi = boost::spirit::qi;
 using qi::raw;
@@ -41,11 +38,8 @@ struct push_annotation_impl {
     template<class RangeIter>
     void operator() (utree& ast, int type, RangeIter const& rng) const 
     {    
-        annotations.push_back( annotation_type(get_location(rng.begin()), type) );
-        std::size_t n = annotations.size() - 1;
-
-        BOOST_ASSERT(n <= (std::numeric_limits<short>::max)());
-        ast.tag(n);
+        std::size_t n = annotations.push(get_location(rng.begin()), type);
+        ast.tag(annotations_type::tag(n));
     }
 };
 
@@ -20,6 +20,7 @@
 #include <parse/expression_grammar.hpp>
 #include <parse/error_handler.hpp>
 #include <parse/annotator.hpp>
+#include <parse/skipper.hpp>
 #include <parse/node_types.hpp>
 
 namespace carto {
@@ -30,16 +31,19 @@ namespace ascii = boost::spirit::ascii;
 using boost::spirit::utf8_symbol_type;
 
 template<typename Iterator>
-struct carto_parser : qi::grammar< Iterator, utree::list_type(), ascii::space_type>
+struct carto_parser : qi::grammar< Iterator, utree::list_type(), skipper_type>
 {
 
-    qi::rule<Iterator, utree(), ascii::space_type> value, element, filter, //expression, 
-                                                   var_val, expr_val,
+    qi::rule<Iterator, utree(), skipper_type> value, element, filter, //expression, 
+                                                   var_val, expr_val, color,
                                                    comment, attachment;
+    
+    qi::rule<Iterator, utree(), skipper_type> number_value, color_value, var_value,
+                                                   string_value, word_value;
                                                    
-    qi::rule<Iterator, utree::list_type(), ascii::space_type> start, variable, attribute, map_style,
+    qi::rule<Iterator, utree::list_type(), skipper_type> start, variable, attribute, map_style,
                                                        style_prefix, style, name_list, element_list,
-                                                       color, mixin, filter_list, expression;
+                                                       mixin, filter_list, expression;
     
     qi::rule<Iterator, utf8_symbol_type()> name, style_name, var_name, enum_val, ustring;
     qi::rule<Iterator, utree::nil_type()> null;
@@ -74,7 +78,7 @@ struct carto_parser : qi::grammar< Iterator, utree::list_type(), ascii::space_ty
         
         start = +(comment | variable | map_style | style);
         
-        comment = as_symbol["/*" >> *(char_ - "*/") > "*/"]
+        comment = as_symbol[comment_text] > "*/"
                   > annotate(_val, CARTO_COMMENT);
         
         element =   comment
@@ -109,24 +113,48 @@ struct carto_parser : qi::grammar< Iterator, utree::list_type(), ascii::space_ty
         variable = as_symbol[var_name] > ":" >> value //(value % ",") > ";"
                    > annotate(_val, CARTO_VARIABLE);
 
-        value =   ( null          >> ";" )
-                | ( color         >> ";" )
-                | ( double_ % "," >> ";" )
-                | ( bool_         >> ";" )
-                //| ( utf8 % ","    >> ";" )
-                | ( var_val       >> ";" )
-                | ( ustring % "," >> ";" )
-                | ( expr_val      >> ";" )
-                | ( enum_val      >> ";" );
+        // The first character of a value rules out most kinds of value, so
+        // it picks the branch to try; each branch tries the kinds that can
+        // start with it in the order null, color, number, bool, variable,
+        // string, expression, enum. The branches don't overlap, so a value
+        // parses the same as it would trying every kind in that order.
+        value =   ( &char_("0-9.+-")  >> number_value )
+                | ( &lit('#')         >> color_value  )
+                | ( &lit('@')         >> var_value    )
+                | ( &char_("a-zA-Z_") >> word_value   )
+                | ( &char_("'\"")     >> string_value )
+                | ( &lit('(')         >> expr_val >> ";" );
+        
+        number_value =   ( double_ % "," >> ";" )
+                       | ( expr_val      >> ";" )
+                       | ( enum_val      >> ";" );
+        
+        color_value =   ( color    >> ";" )
+                      | ( expr_val >> ";" );
+        
+        var_value =   ( var_val  >> ";" )
+                    | ( expr_val >> ";" );
+        
+        string_value =   ( ustring % "," >> ";" )
+                       | ( expr_val      >> ";" );
+        
+        // named colors, nan and inf, function calls and enums
+        word_value =   ( null          >> ";" )
+                     | ( color         >> ";" )
+                     | ( double_ % "," >> ";" )
+                     | ( bool_         >> ";" )
+                     | ( expr_val      >> ";" )
+                     | ( enum_val      >> ";" );
         
         ustring =   lexeme['\'' >> *(char_-'\'') > '\'']
                   | lexeme['"'  >> *(char_-'"')  > '"' ];
                 
         null = "null" >> qi::attr(spirit::nil); 
-        color =   css_color[_val = color_conv(qi::_1)] > annotate(_val, CARTO_COLOR);
+        // mapnik's color grammar is declared with the ascii::space skipper
+        color =   qi::skip(ascii::space)[css_color][_val = color_conv(qi::_1)] > annotate(_val, CARTO_COLOR);
         enum_val = lexeme[+(char_("a-zA-Z_-"))];
         
-        var_val = var_name > annotate(_val, CARTO_VARIABLE);
+        var_val = var_name > annotate(_val, CARTO_VARIABLE | annotations_type::name_flag);
         expr_val = expression > annotate(_val, CARTO_EXPRESSION) ;
         
         expression = expression_text;// 
@@ -9,6 +9,7 @@
 #include <utility/color.hpp>
 #include <parse/error_handler.hpp>
 #include <parse/annotator.hpp>
+#include <parse/skipper.hpp>
 #include <parse/node_types.hpp>
 
 namespace carto {
@@ -48,11 +49,11 @@ struct wrap_impl
 };
 
 template<typename Iterator>
-struct expression_parser : qi::grammar< Iterator, utree(), ascii::space_type>
+struct expression_parser : qi::grammar< Iterator, utree(), skipper_type>
 {
     
-    qi::rule<Iterator, utree(), ascii::space_type> expression, term, factor; 
-    qi::rule<Iterator, utree::list_type(), ascii::space_type> function, color, start; 
+    qi::rule<Iterator, utree(), skipper_type> expression, term, factor; 
+    qi::rule<Iterator, utree::list_type(), skipper_type> function, color, start; 
     qi::rule<Iterator, boost::spirit::utf8_symbol_type()> name, var_name, function_name, ustring;
     
     typedef error_handler_impl<Iterator> error_handler_type;
@@ -95,8 +96,8 @@ struct expression_parser : qi::grammar< Iterator, utree(), ascii::space_type>
         factor = ( double_[_val = _1] >> "%" > annotate(_val, CARTO_EXP_PERCENTAGE) )
                | ( double_[_val = _1] )
                | ( ustring[_val = _1] )
-               | ( css_color[_val = color_conv(_1)] > annotate(_val, CARTO_EXP_COLOR) )
-               | ( var_name[_val = _1] > annotate(_val, CARTO_EXP_VAR) )
+               | ( qi::skip(ascii::space)[css_color][_val = color_conv(_1)] > annotate(_val, CARTO_EXP_COLOR) )
+               | ( var_name[_val = _1] > annotate(_val, CARTO_EXP_VAR | annotations_type::name_flag) )
                | ( function[_val = _1] > annotate(_val, CARTO_EXP_FUNCTION) )
                | ( "(" > expression[_val = _1] > ")" )
                | ( "-" > factor[_val = wrap(_1)] > annotate(_val, CARTO_EXP_NEG) )
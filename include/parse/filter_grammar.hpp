@@ -7,6 +7,7 @@
 #include <parse/expression_grammar.hpp>
 #include <parse/error_handler.hpp>
 #include <parse/annotator.hpp>
+#include <parse/skipper.hpp>
 
 #include <utility/position_iterator.hpp>
 
@@ -39,10 +40,10 @@ enum filter_node_type
 
 
 template<typename Iterator>
-struct filter_parser : qi::grammar< Iterator, utree(), ascii::space_type>
+struct filter_parser : qi::grammar< Iterator, utree(), skipper_type>
 {
     
-    qi::rule<Iterator, utree(), ascii::space_type> logical_expr, not_expr, cond_expr, 
+    qi::rule<Iterator, utree(), skipper_type> logical_expr, not_expr, cond_expr, 
                                             equality_expr, lhs_expr, rhs_expr, 
                                             regex_match_expr, regex_replace_expr, 
                                             null, var_attr, var,
@@ -55,6 +56,7 @@ struct filter_parser : qi::grammar< Iterator, utree(), ascii::space_type>
     phoenix::function<error_handler_type> const error;
     annotator<Iterator> annotate;
     phoenix::function<combine_impl> const combine;
+    phoenix::function<wrap_impl> const wrap;
     
     filter_parser (std::string const& source, annotations_type& annotations)
       : filter_parser::base_type(logical_expr),
@@ -77,7 +79,7 @@ struct filter_parser : qi::grammar< Iterator, utree(), ascii::space_type>
                   | ( (lit("or")  | lit("||")) >> not_expr[combine(_val, _1)] > annotate(_val, FILTER_OR)  )
                 );
 
-        not_expr =   ( (lit("not") | lit('!')) >> cond_expr[_val = _1] > annotate(_val, FILTER_NOT) )
+        not_expr =   ( (lit("not") | lit('!')) >> cond_expr[_val = wrap(_1)] > annotate(_val, FILTER_NOT) )
                    | cond_expr [_val = _1 ];
 
         cond_expr =   equality_expr[_val = _1] 
@@ -111,8 +113,8 @@ struct filter_parser : qi::grammar< Iterator, utree(), ascii::space_type>
         sq_attr = '[' >> attr > ']';
         
         var_name = lexeme["@" > name];
-        var_attr = var_name > annotate(_val, FILTER_VAR_ATTR);
-        var      = var_name > annotate(_val, FILTER_VAR);
+        var_attr = var_name > annotate(_val, FILTER_VAR_ATTR | annotations_type::name_flag);
+        var      = var_name > annotate(_val, FILTER_VAR | annotations_type::name_flag);
         
         lhs_expr =   attr
                    | sq_attr
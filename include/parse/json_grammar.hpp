@@ -15,6 +15,7 @@
 
 #include <parse/error_handler.hpp>
 #include <parse/annotator.hpp>
+#include <parse/skipper.hpp>
 
 namespace carto {
 
@@ -32,12 +33,12 @@ enum node_type
 };
 
 template<typename Iterator>
-struct json_parser : qi::grammar< Iterator, utree(), ascii::space_type>
+struct json_parser : qi::grammar< Iterator, utree(), skipper_type>
 {
-    qi::rule<Iterator, utree(), ascii::space_type> start, value;
-    qi::rule<Iterator, utree::list_type(), ascii::space_type> member_pair, object, array;
+    qi::rule<Iterator, utree(), skipper_type> start, value;
+    qi::rule<Iterator, utree::list_type(), skipper_type> member_pair, object, array;
     qi::rule<Iterator, utf8_symbol_type()> member, ustring;
-    qi::rule<Iterator, utf8_symbol_type(), ascii::space_type> empty_object, empty_array;
+    qi::rule<Iterator, utf8_symbol_type(), skipper_type> empty_object, empty_array;
     qi::rule<Iterator, utree::nil_type()> null;
 
     typedef error_handler_impl<Iterator> error_handler_type;
@@ -8,65 +8,56 @@
 #ifndef PARSE_TREE_H
 #define PARSE_TREE_H
 
+#include <exception.hpp>
 #include <utility/carto_error.hpp>
+#include <utility/line_index.hpp>
 #include <utility/position_iterator.hpp>
 
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/spirit/include/qi.hpp>
 #include <boost/spirit/include/support_utree.hpp>
 #include <boost/spirit/home/support/assert_msg.hpp>
 #include <boost/spirit/include/support_istream_iterator.hpp>
 
 #include <parse/json_grammar.hpp>
+#include <parse/skipper.hpp>
 
 namespace carto {
 
 using boost::spirit::utree;
 
+// Copies share the tree and its annotations, which are only written to
+// while the tree is built. Locations are looked up by node address, so the
+// shared tree must not be modified structurally once finalized.
 class parse_tree {
 
 private:
-    utree _ast;    
-    annotations_type _annotations;
+    struct data {
+        utree ast;
+        annotations_type annotations;
+    };
+
+    boost::shared_ptr<data> _data;
 
 public:
     parse_tree(void)
-      : _ast(), 
-        _annotations()
-    {
-        //FIXME - utree.tag() returns 0 even if not tagged so fill up 0 position 
-        _annotations.push_back(annotation_type());
-    }
-    
-    parse_tree& operator= (parse_tree const& other) {
-        if (!equal(other)) {
-            _ast = other._ast;
-            _annotations = other._annotations;
-        }
-        return *this;
-    }  
+      : _data(new data()) { }
 
     utree& ast (void) {
-        return _ast;
+        return _data->ast;
     }
 
     utree const& ast (void) const {
-        return _ast;
+        return _data->ast;
     }
 
     annotations_type& annotations (void) {
-        return _annotations;
+        return _data->annotations;
     }
 
     annotations_type const& annotations (void) const {
-        return _annotations;
-    }
-
-    annotation_type& annotations (int i) {
-        return _annotations[i];
-    }
-
-    annotation_type const& annotations (int i) const {
-        return _annotations[i];
+        return _data->annotations;
     }
 
     bool operator== (parse_tree const& other) const {
@@ -79,30 +70,49 @@ public:
 
 private:
     bool equal (parse_tree const& other) const {
-        return    (_ast == other._ast)
-               && (_annotations == other._annotations);
+        return    (ast() == other.ast())
+               && (annotations().offsets(ast()) == other.annotations().offsets(other.ast()));
     }
 };
 
-template<typename parser_type>
-parse_tree build_parse_tree(std::string const& in, std::string const& path = "./")
+template<typename parser_type, typename Iterator>
+parse_tree build_parse_tree(boost::iterator_range<Iterator> const& in, std::string const& path = "./")
 { 
     parse_tree pt;
+    pt.annotations().reserve(annotations_type::estimate(in.size()));
+    pt.annotations().set_lines(boost::make_shared<line_index>(in.begin(), in.end()));
     
-    typedef position_iterator<std::string::const_iterator> iter;
+    typedef position_iterator<Iterator> iter;
     
     parser_type p(path, pt.annotations());
     
     iter it( in.begin()),
          end(in.end());
 
-    bool r = qi::phrase_parse(it, end, p, boost::spirit::ascii::space, pt.ast());
+    bool r;
+    
+    try {
+        r = qi::phrase_parse(it, end, p, whitespace, pt.ast());
+    } catch (carto::exception& e) {
+        // syntax errors are raised with the offset they were found at
+        e.set_lines(pt.annotations().lines());
+        throw;
+    }
+    
     if (!r)
         throw carto_error("Parser failed!");
     
+    pt.annotations().finalize(pt.ast());
+    
     return pt;
 }
 
+template<typename parser_type>
+parse_tree build_parse_tree(std::string const& in, std::string const& path = "./")
+{ 
+    return build_parse_tree<parser_type>(boost::make_iterator_range(in.begin(), in.end()), path);
+}
+
 }
 
 #endif
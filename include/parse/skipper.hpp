@@ -0,0 +1,217 @@
+#ifndef SKIPPER_H
+#define SKIPPER_H
+
+#include <cstring>
+
+#include <boost/spirit/include/qi.hpp>
+#include <boost/spirit/include/support_utree.hpp>
+
+#include <utility/position_iterator.hpp>
+
+namespace carto {
+
+namespace qi = boost::spirit::qi;
+
+// Scanners for the parts of a stylesheet that need no grammar: the
+// whitespace between tokens and the body of a comment. Both look at the
+// underlying characters directly and move a position_iterator to the end
+// of the run in one step, instead of matching a character at a time
+// through qi and the iterator adaptor.
+//
+//   whitespace      skips the same characters as ascii::space, and is the
+//                   skipper of all the stylesheet grammars
+//   comment_text    "/*" and everything up to the next "*/", which is left
+//                   for the grammar to expect. The attribute is the text
+//                   without whitespace, the way a skipping char_ reads it.
+
+BOOST_SPIRIT_TERMINAL(whitespace)
+BOOST_SPIRIT_TERMINAL(comment_text)
+
+typedef whitespace_type skipper_type;
+
+namespace detail {
+
+template<class Iterator>
+struct raw_iterator {
+    typedef Iterator type;
+
+    static Iterator const& get(Iterator const& it)
+    {
+        return it;
+    }
+
+    static void advance(Iterator& it, Iterator const& pos)
+    {
+        it = pos;
+    }
+};
+
+template<class Iterator>
+struct raw_iterator< position_iterator<Iterator> > {
+    typedef Iterator type;
+
+    static Iterator const& get(position_iterator<Iterator> const& it)
+    {
+        return it.base();
+    }
+
+    static void advance(position_iterator<Iterator>& it, Iterator const& pos)
+    {
+        it.advance_to(pos);
+    }
+};
+
+inline bool is_space(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+template<class Iterator>
+Iterator skip_space(Iterator it, Iterator const& end)
+{
+    while (it != end && is_space(*it))
+        ++it;
+
+    return it;
+}
+
+template<class Iterator>
+Iterator find_comment_end(Iterator it, Iterator const& end)
+{
+    for (; it != end; ++it) {
+        if (*it != '*')
+            continue;
+
+        Iterator next = it;
+        if (++next != end && *next == '/')
+            return it;
+    }
+
+    return end;
+}
+
+inline char const* find_comment_end(char const* it, char const* end)
+{
+    while (it != end) {
+        char const* star = static_cast<char const*>(std::memchr(it, '*', end - it));
+
+        if (!star)
+            return end;
+        if (star + 1 != end && star[1] == '/')
+            return star;
+
+        it = star + 1;
+    }
+
+    return end;
+}
+
+}
+
+struct whitespace_parser : qi::primitive_parser<whitespace_parser>
+{
+    template<class Context, class Iterator>
+    struct attribute {
+        typedef boost::spirit::unused_type type;
+    };
+
+    template<class Iterator, class Context, class Skipper, class Attribute>
+    bool parse(Iterator& first, Iterator const& last, Context&, Skipper const&, Attribute&) const
+    {
+        typedef detail::raw_iterator<Iterator> raw;
+
+        typename raw::type it = detail::skip_space(raw::get(first), raw::get(last));
+
+        if (it == raw::get(first))
+            return false;
+
+        raw::advance(first, it);
+        return true;
+    }
+
+    template<class Context>
+    boost::spirit::info what(Context&) const
+    {
+        return boost::spirit::info("whitespace");
+    }
+};
+
+struct comment_text_parser : qi::primitive_parser<comment_text_parser>
+{
+    template<class Context, class Iterator>
+    struct attribute {
+        typedef boost::spirit::utf8_symbol_type type;
+    };
+
+    template<class Iterator, class Context, class Skipper, class Attribute>
+    bool parse(Iterator& first, Iterator const& last, Context&, Skipper const& skipper, Attribute& attr) const
+    {
+        typedef detail::raw_iterator<Iterator> raw;
+        typedef typename raw::type raw_type;
+
+        qi::skip_over(first, last, skipper);
+
+        raw_type it  = raw::get(first),
+                 end = raw::get(last);
+
+        if (it == end || *it != '/' || ++it == end || *it != '*')
+            return false;
+
+        raw_type body = ++it;
+        it = detail::find_comment_end(body, end);
+
+        for (; body != it; ++body) {
+            if (!detail::is_space(*body))
+                boost::spirit::traits::push_back(attr, *body);
+        }
+
+        raw::advance(first, it);
+        return true;
+    }
+
+    template<class Context>
+    boost::spirit::info what(Context&) const
+    {
+        return boost::spirit::info("comment");
+    }
+};
+
+}
+
+namespace boost { namespace spirit {
+
+template<>
+struct use_terminal<qi::domain, carto::tag::whitespace> : mpl::true_ { };
+
+template<>
+struct use_terminal<qi::domain, carto::tag::comment_text> : mpl::true_ { };
+
+namespace qi {
+
+template<typename Modifiers>
+struct make_primitive<carto::tag::whitespace, Modifiers>
+{
+    typedef carto::whitespace_parser result_type;
+
+    result_type operator()(unused_type, unused_type) const
+    {
+        return result_type();
+    }
+};
+
+template<typename Modifiers>
+struct make_primitive<carto::tag::comment_text, Modifiers>
+{
+    typedef carto::comment_text_parser result_type;
+
+    result_type operator()(unused_type, unused_type) const
+    {
+        return result_type();
+    }
+};
+
+}
+
+}}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef PROPERTY_TABLE_H
+#define PROPERTY_TABLE_H
+
+#include <boost/spirit/include/support_utree.hpp>
+
+namespace carto {
+
+enum symbolizer_kind {
+    POLYGON_SYMBOLIZER,
+    LINE_SYMBOLIZER,
+    MARKERS_SYMBOLIZER,
+    POINT_SYMBOLIZER,
+    LINE_PATTERN_SYMBOLIZER,
+    POLYGON_PATTERN_SYMBOLIZER,
+    RASTER_SYMBOLIZER,
+    BUILDING_SYMBOLIZER,
+    TEXT_SYMBOLIZER,
+    SHIELD_SYMBOLIZER
+};
+
+enum property_type {
+    PROP_POLYGON_FILL, PROP_POLYGON_GAMMA, PROP_POLYGON_OPACITY,
+
+    PROP_LINE_DASHARRAY, PROP_LINE_COLOR, PROP_LINE_WIDTH, PROP_LINE_OPACITY,
+    PROP_LINE_JOIN, PROP_LINE_CAP, PROP_LINE_GAMMA, PROP_LINE_DASH_OFFSET,
+
+    PROP_MARKER_FILE, PROP_MARKER_OPACITY, PROP_MARKER_PLACEMENT, PROP_MARKER_TYPE,
+    PROP_MARKER_WIDTH, PROP_MARKER_HEIGHT, PROP_MARKER_FILL,
+    PROP_MARKER_ALLOW_OVERLAP, PROP_MARKER_SPACING, PROP_MARKER_MAX_ERROR,
+    PROP_MARKER_TRANSFORM, PROP_MARKER_LINE_COLOR, PROP_MARKER_LINE_WIDTH,
+    PROP_MARKER_LINE_OPACITY,
+
+    PROP_POINT_FILE, PROP_POINT_ALLOW_OVERLAP, PROP_POINT_IGNORE_PLACEMENT,
+    PROP_POINT_OPACITY, PROP_POINT_PLACEMENT, PROP_POINT_TRANSFORM,
+
+    PROP_LINE_PATTERN_FILE,
+
+    PROP_POLYGON_PATTERN_FILE, PROP_POLYGON_PATTERN_ALIGNMENT,
+
+    PROP_RASTER_OPACITY, PROP_RASTER_MODE, PROP_RASTER_SCALING,
+
+    PROP_BUILDING_FILL, PROP_BUILDING_FILL_OPACITY, PROP_BUILDING_HEIGHT,
+
+    PROP_TEXT_FACE_NAME, PROP_TEXT_NAME, PROP_TEXT_SIZE, PROP_TEXT_RATIO,
+    PROP_TEXT_WRAP_WIDTH, PROP_TEXT_SPACING, PROP_TEXT_CHARACTER_SPACING,
+    PROP_TEXT_LINE_SPACING, PROP_TEXT_LABEL_POSITION_TOLERANCE,
+    PROP_TEXT_MAX_CHAR_ANGLE_DELTA, PROP_TEXT_FILL, PROP_TEXT_OPACITY,
+    PROP_TEXT_HALO_FILL, PROP_TEXT_HALO_RADIUS, PROP_TEXT_DX, PROP_TEXT_DY,
+    PROP_TEXT_VERTICAL_ALIGNMENT,
+    PROP_TEXT_AVOID_EDGES, PROP_TEXT_MIN_DISTANCE, PROP_TEXT_MIN_PADDING,
+    PROP_TEXT_ALLOW_OVERLAP, PROP_TEXT_PLACEMENT, PROP_TEXT_PLACEMENT_TYPE,
+    PROP_TEXT_PLACEMENTS, PROP_TEXT_TRANSFORM,
+
+    PROP_SHIELD_NAME, PROP_SHIELD_FACE_NAME, PROP_SHIELD_SIZE,
+    PROP_SHIELD_SPACING, PROP_SHIELD_CHARACTER_SPACING,
+    PROP_SHIELD_LINE_SPACING, PROP_SHIELD_FILL, PROP_SHIELD_TEXT_DX,
+    PROP_SHIELD_TEXT_DY, PROP_SHIELD_DX, PROP_SHIELD_DY,
+    PROP_SHIELD_MIN_DISTANCE, PROP_SHIELD_PLACEMENT
+};
+
+struct property {
+    char const* name;
+    symbolizer_kind symbolizer;
+    property_type type;
+};
+
+// Finds a style property by the name node of an attribute, or returns 0 if
+// there is no such property. The names are hashed into a table once, on 
+// first use, and looked up in place so no string is built per attribute.
+property const* find_property(boost::spirit::utree const& name);
+
+}
+
+#endif
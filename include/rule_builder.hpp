@@ -0,0 +1,92 @@
+#ifndef RULE_BUILDER_H
+#define RULE_BUILDER_H
+
+#include <boost/shared_ptr.hpp>
+#include <boost/mpl/begin_end.hpp>
+#include <boost/mpl/distance.hpp>
+#include <boost/mpl/find.hpp>
+#include <boost/mpl/size.hpp>
+
+#include <mapnik/rule.hpp>
+#include <mapnik/expression.hpp>
+
+namespace carto {
+
+// A rule under construction: filter, scale denominators and the
+// symbolizers set so far, together with the position of the first
+// symbolizer of each type so finding it is an array lookup. Copies share
+// their symbolizers until one of them changes, so the rule of a nested
+// style is a copy of its parent's that costs nothing unless it sets
+// properties of its own. A mapnik::rule is only built by materialize,
+// for styles that end up with symbolizers. Symbolizers have to be added
+// through append so the index stays current.
+class rule_builder {
+
+public:
+    typedef mapnik::symbolizer::types symbolizer_types;
+
+    static int const symbolizer_count = boost::mpl::size<symbolizer_types>::value;
+
+    // position of T in the symbolizer variant, i.e. its which()
+    template<class T>
+    struct which {
+        typedef typename boost::mpl::begin<symbolizer_types>::type first;
+        typedef typename boost::mpl::find<symbolizer_types, T>::type pos;
+
+        static int const value = boost::mpl::distance<first, pos>::value;
+    };
+
+    rule_builder();
+
+    mapnik::expression_ptr const& get_filter() const;
+    void set_filter(mapnik::expression_ptr const& filter_);
+
+    double get_min_scale() const;
+    double get_max_scale() const;
+    void set_min_scale(double scale);
+    void set_max_scale(double scale);
+
+    bool empty() const;
+
+    template<class T>
+    T* find()
+    {
+        if (!syms || syms->slots[which<T>::value] < 0)
+            return 0;
+
+        symbolizer_set& set = writable();
+
+        return boost::get<T>(&(*(set.rule.begin() + set.slots[which<T>::value])));
+    }
+
+    void append(mapnik::symbolizer const& sym);
+
+    // shares the symbolizers of other, which keeps its own
+    void copy_symbolizers(rule_builder const& other);
+
+    // The finished rule. It may share state with the symbolizers of this
+    // builder, which are copied before they are changed again.
+    mapnik::rule materialize();
+
+private:
+    struct symbolizer_set {
+        mapnik::rule rule;
+        int slots[symbolizer_count];
+
+        symbolizer_set();
+        symbolizer_set(symbolizer_set const& other);
+    };
+
+    symbolizer_set& writable();
+
+    boost::shared_ptr<symbolizer_set> syms;
+    bool materialized;
+
+    mapnik::expression_ptr filter;
+    double min_scale;
+    double max_scale;
+};
+
+}
+
+#endif
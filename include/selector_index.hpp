@@ -0,0 +1,43 @@
+#ifndef SELECTOR_INDEX_H
+#define SELECTOR_INDEX_H
+
+#include <string>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+namespace carto {
+
+// Map styles by the selector tokens of their names, for attaching them to
+// layers. A style named "#roads.major::casing" has the tokens "#roads" and
+// "major"; it matches a layer whose own tokens appear among them in the
+// same order. Every token keeps the list of styles that contain it, so
+// matching a layer only looks at the styles that contain its rarest token
+// instead of at every style. Matches come back in the order the styles
+// were inserted.
+class selector_index {
+
+public:
+    typedef std::vector<std::string> selectors;
+
+    void insert(std::string const& style_name);
+
+    void match(selectors const& layer, std::vector<std::string>& styles) const;
+
+    std::size_t size() const;
+
+    static selectors split(std::string const& style_name);
+
+private:
+    typedef boost::unordered_map< std::string, std::vector<std::size_t> > posting_map;
+
+    std::vector<std::string> names_;
+    std::vector<selectors> tokens_;
+    posting_map postings_;
+
+    static bool matches(selectors const& layer, selectors const& style);
+};
+
+}
+
+#endif
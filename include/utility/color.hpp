@@ -8,15 +8,26 @@ namespace carto {
 
 using boost::spirit::utree;
 
+// Colors travel through the tree as 4 byte binary nodes holding red, green,
+// blue and alpha. They are small enough to be stored inside the utree 
+// itself, so making or copying one never allocates, and nothing else in 
+// the tree is binary so a color is recognized by its type alone.
+utree make_color(mapnik::color const& color);
+
+// components are truncated to bytes the way mapnik::color would
+utree make_color(double r, double g, double b, double a);
+
+bool is_color(utree const& ut);
+
 struct color_conv_impl
 {
     template <typename T>
     struct result
     {
-        typedef utree::list_type type;
+        typedef utree type;
     };
     
-    utree::list_type operator() (mapnik::color color) const;
+    utree operator() (mapnik::color color) const;
 };
 
 }
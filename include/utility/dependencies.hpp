@@ -0,0 +1,22 @@
+#ifndef DEPENDENCIES_H
+#define DEPENDENCIES_H
+
+#include <set>
+#include <string>
+
+namespace carto {
+
+// What a single stylesheet contributed to and took from a project build:
+// top level variables it defined, variables it looked up and the names of
+// the map styles it added rules to.
+struct dependency_set {
+    std::set<std::string> defines;
+    std::set<std::string> uses;
+    std::set<std::string> styles;
+
+    void clear();
+};
+
+}
+
+#endif
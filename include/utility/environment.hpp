@@ -8,30 +8,77 @@
 #ifndef ENVIRONMENT_H
 #define ENVIRONMENT_H
 
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
 #include <boost/spirit/include/support_utree.hpp>
-#include <boost/unordered_map.hpp>
+
+#include <parse/annotation_table.hpp>
+#include <utility/dependencies.hpp>
+#include <utility/persistent_map.hpp>
+#include <utility/source_location.hpp>
+#include <utility/symbol_table.hpp>
 
 namespace carto {
 
+// Variable scopes. Names are interned to ids in the shared symbol table, or
+// come with the id their parse tree stored on them, and the bindings
+// visible in a scope are a persistent map from ids to values. Opening a child scope
+// copies the map of its parent, which is a pointer copy, and definitions
+// in the child only change the child's own version, so a scope is a
+// snapshot that stays valid however long it lives and whatever its parent
+// defines later. Nothing is shared mutably except the symbol table, which
+// is locked, so environments can be handed to other threads. Environments
+// that record into the same dependency_set must stay on one thread. A value
+// is a copy of the node it was defined with, so the binding keeps the
+// location of the definition for errors about the value.
 struct environment {
 
 private:
-    environment const* parent;
-    typedef boost::unordered_map<std::string, boost::spirit::utree> map_type;
-    map_type definitions;
+    struct binding {
+        boost::spirit::utree value;
+        unsigned depth;
+        source_location loc;
+        
+        binding(boost::spirit::utree const& value_, unsigned depth_, source_location const& loc_)
+          : value(value_), depth(depth_), loc(loc_) { }
+    };
+    
+    persistent_map<binding> bindings;
+    unsigned depth;
+    dependency_set* deps;
+    
+    // ids already reported to deps, shared with the children of the scope
+    // that started recording
+    boost::shared_ptr< std::vector<bool> > recorded;
+    
+    void record_use (symbol_id id) const;
 
 public:
     environment(void);
 
     environment(environment const& parent_);
+    
+    symbol_id intern (std::string const& name) const;
+    symbol_id intern (boost::spirit::utree const& name) const;
+    std::string const& name (symbol_id id) const;
 
+    boost::spirit::utree lookup (symbol_id id) const;
     boost::spirit::utree lookup (std::string const& name) const;
     
-    void define (std::string const& name, boost::spirit::utree const& val);
+    // where a variable was defined, unknown if it is not
+    source_location location (symbol_id id) const;
+    
+    void define (symbol_id id, boost::spirit::utree const& val, 
+                 source_location const& loc = source_location());
+    void define (std::string const& name, boost::spirit::utree const& val,
+                 source_location const& loc = source_location());
 
     bool defined (std::string const& name) const;
     
     bool locally_defined (std::string const& name) const;
+    
+    void set_dependencies (dependency_set* deps_);
 };
 
 
@@ -0,0 +1,39 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+namespace carto {
+
+// Blocks until one of a set of files changes. On Linux the parent 
+// directories are watched with inotify so editors that save by writing a
+// temporary file and renaming it over the original are picked up too,
+// elsewhere modification times are polled.
+class file_watcher : private boost::noncopyable {
+
+public:
+    file_watcher();
+    ~file_watcher();
+
+    void add(std::string const& filename);
+    void clear();
+
+    // returns the watched files that changed, bursts of changes to them
+    // arriving within a short delay of each other are reported together;
+    // if events were lost every watched file is reported
+    std::vector<std::string> wait();
+
+private:
+    int fd_;
+    std::map<int, std::string> dirs_;
+    std::map<std::string, std::time_t> files_;
+};
+
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+namespace carto {
+
+// Where the lines of a source text start, so a byte offset into it can be
+// turned back into the line and column of a source_location. The index is
+// built with one scan over the text when it is parsed and only consulted
+// when a location is printed.
+//
+// Positions follow the rules the parser always used: lines count from 1
+// and columns from 0, a tab is tab_length columns wide, and "\r\n", "\n\r"
+// and any further alternation of the two only end one line.
+class line_index {
+
+public:
+    enum { tab_length = 2 };
+
+    line_index();
+    line_index(char const* first, char const* last);
+
+    template<class Iterator>
+    line_index(Iterator first, Iterator last)
+    {
+        std::string text(first, last);
+        scan(text.data(), text.data() + text.size());
+    }
+
+    int line(boost::uint32_t offset) const;
+    int column(boost::uint32_t offset) const;
+
+    std::size_t lines() const;
+
+private:
+    void scan(char const* first, char const* last);
+
+    // offsets of the first character of every line, of every tab and of
+    // every line break character that did not end a line
+    std::vector<boost::uint32_t> starts_;
+    std::vector<boost::uint32_t> tabs_;
+    std::vector<boost::uint32_t> silent_;
+};
+
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+
+#include <boost/utility.hpp>
+#include <boost/range/iterator_range.hpp>
+
+namespace carto {
+
+// Read-only view of a file's contents. Regular files are mmap'd so the
+// parser can run directly over the mapped bytes, anything else (pipes,
+// fifos, character devices) is read into an owned buffer instead.
+class mapped_file : private boost::noncopyable {
+
+public:
+    typedef char const* const_iterator;
+    typedef boost::iterator_range<const_iterator> range_type;
+
+    explicit mapped_file(std::string const& filename);
+    ~mapped_file();
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    std::size_t size() const;
+
+    range_type range() const;
+
+    bool is_mapped() const;
+
+private:
+    void read_all(int fd, std::string const& filename);
+
+    char const* data_;
+    std::size_t size_;
+    bool mapped_;
+    std::string buffer_;
+};
+
+}
+
+#endif
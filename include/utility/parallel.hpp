@@ -0,0 +1,68 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace carto {
+
+namespace detail {
+
+template<class Function>
+struct parallel_worker {
+    Function& f;
+    boost::mutex& mutex;
+    std::size_t& next;
+    std::size_t n;
+
+    parallel_worker(Function& f_, boost::mutex& mutex_, std::size_t& next_, std::size_t n_)
+      : f(f_), mutex(mutex_), next(next_), n(n_) { }
+
+    void operator() ()
+    {
+        for (;;) {
+            std::size_t i;
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                if (next == n) return;
+                i = next++;
+            }
+            f(i);
+        }
+    }
+};
+
+}
+
+// Calls f(0) ... f(n-1) on a pool of up to `threads` workers (defaults to
+// the number of hardware threads). f must not throw; jobs are handed out
+// in index order but may complete in any order.
+template<class Function>
+void parallel_for(std::size_t n, Function f, unsigned threads = 0)
+{
+    if (threads == 0)
+        threads = std::max(1u, boost::thread::hardware_concurrency());
+
+    threads = std::min<std::size_t>(threads, n);
+
+    if (threads <= 1) {
+        for (std::size_t i = 0; i != n; ++i)
+            f(i);
+        return;
+    }
+
+    boost::mutex mutex;
+    std::size_t next = 0;
+
+    boost::thread_group pool;
+    for (unsigned t = 0; t != threads; ++t)
+        pool.create_thread(detail::parallel_worker<Function>(f, mutex, next, n));
+
+    pool.join_all();
+}
+
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef PERSISTENT_MAP_H
+#define PERSISTENT_MAP_H
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <utility/symbol_table.hpp>
+
+namespace carto {
+
+// Immutable map from symbol ids to values, stored as a hash array mapped
+// trie over the bits of the id: every node branches on five bits and only
+// holds the branches in use, found through a bitmap. insert returns a new
+// map that shares everything but the path to the key with the old one, so
+// copying a map is a pointer copy and older versions stay valid. Nodes are
+// never changed once built, so versions can be read from several threads.
+template<class T>
+class persistent_map {
+
+    static unsigned const bits = 5;
+    static boost::uint32_t const mask = (1u << bits) - 1;
+
+    struct node;
+    typedef boost::shared_ptr<node const> node_ptr;
+    typedef boost::shared_ptr<T const> value_ptr;
+
+    // a value, or a subtrie for the keys that share this branch
+    struct entry {
+        symbol_id key;
+        value_ptr value;
+        node_ptr child;
+
+        entry(symbol_id key_, value_ptr const& value_)
+          : key(key_), value(value_), child() { }
+
+        entry(node_ptr const& child_)
+          : key(), value(), child(child_) { }
+    };
+
+    struct node {
+        boost::uint32_t bitmap;
+        std::vector<entry> entries;
+
+        node()
+          : bitmap(0), entries() { }
+    };
+
+    node_ptr root;
+
+    static unsigned popcount(boost::uint32_t x)
+    {
+        x = x - ((x >> 1) & 0x55555555u);
+        x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+        return (((x + (x >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+    }
+
+    static boost::uint32_t branch(symbol_id key, unsigned shift)
+    {
+        return boost::uint32_t(1) << ((key >> shift) & mask);
+    }
+
+    // distinct keys always part within 32 bits, so shift stays below 32
+    static node_ptr insert(node const* n, unsigned shift, symbol_id key, value_ptr const& value)
+    {
+        boost::shared_ptr<node> copy = n ? boost::make_shared<node>(*n)
+                                         : boost::make_shared<node>();
+
+        boost::uint32_t bit = branch(key, shift);
+        unsigned i = popcount(copy->bitmap & (bit - 1));
+
+        if (!(copy->bitmap & bit)) {
+            copy->bitmap |= bit;
+            copy->entries.insert(copy->entries.begin() + i, entry(key, value));
+            return copy;
+        }
+
+        entry& e = copy->entries[i];
+
+        if (e.child) {
+            e.child = insert(e.child.get(), shift + bits, key, value);
+        } else if (e.key == key) {
+            e.value = value;
+        } else {
+            node_ptr child = insert(0, shift + bits, e.key, e.value);
+            e = entry(insert(child.get(), shift + bits, key, value));
+        }
+
+        return copy;
+    }
+
+public:
+    persistent_map()
+      : root() { }
+
+    bool empty() const
+    {
+        return !root;
+    }
+
+    T const* find(symbol_id key) const
+    {
+        node const* n = root.get();
+
+        for (unsigned shift = 0; n; shift += bits) {
+            boost::uint32_t bit = branch(key, shift);
+
+            if (!(n->bitmap & bit))
+                return 0;
+
+            entry const& e = n->entries[popcount(n->bitmap & (bit - 1))];
+
+            if (!e.child)
+                return (e.key == key) ? e.value.get() : 0;
+
+            n = e.child.get();
+        }
+
+        return 0;
+    }
+
+    persistent_map insert(symbol_id key, T const& value) const
+    {
+        persistent_map map;
+        map.root = insert(root.get(), 0, key, value_ptr(boost::make_shared<T>(value)));
+        return map;
+    }
+};
+
+}
+
+#endif
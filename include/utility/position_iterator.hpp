@@ -9,7 +9,9 @@
 #ifndef MAPNIK_POSITION_ITERATOR_H
 #define MAPNIK_POSITION_ITERATOR_H
 
-#include <boost/detail/iterator.hpp>
+#include <iterator>
+
+#include <boost/cstdint.hpp>
 #include <boost/iterator/iterator_adaptor.hpp>
 #include <boost/range/iterator_range.hpp>
 
@@ -17,7 +19,10 @@
  
 namespace carto {
 
-template <typename Iterator, int TabLength = 2>
+// Iterator adaptor that counts the characters it has been moved over, so
+// the parser can record where things are as byte offsets. Turning them
+// into lines and columns is left to the line_index of the text.
+template <typename Iterator>
 class position_iterator
   : public boost::iterator_adaptor< position_iterator<Iterator>, 
                                     Iterator, 
@@ -27,82 +32,45 @@ class position_iterator
 public:
     position_iterator()
       : position_iterator::iterator_adaptor_(),
-        loc(1, 0), 
-        prev(0)
+        pos(0)
     { }
  
     explicit position_iterator (Iterator base)
       : position_iterator::iterator_adaptor_(base),
-        loc(1, 0), 
-        prev(0)
+        pos(0)
     { }
  
-    int& line() {
-        return loc.line;
-    }
- 
-    int const& line() const {
-        return loc.line;
-    }
- 
-    int& column() {
-        return loc.column;
+    boost::uint32_t offset() const {
+        return pos;
     }
  
-    int const& column() const {
-        return loc.column;
+    source_location location() const {
+        return source_location(pos);
     }
  
-    source_location& location() {
-        return loc;
-    }
- 
-    source_location const& location() const {
-        return loc;
+    // Moves forward to p, which must not lie before the current position.
+    // Scanners that find the end of a run on the underlying characters use
+    // this to skip the iterator adaptor for each of them.
+    void advance_to(Iterator p) {
+        pos += std::distance(this->base(), p);
+        this->base_reference() = p;
     }
  
 private:
     friend class boost::iterator_core_access;
  
     void increment() {
-        
-        using boost::detail::iterator_traits;
- 
-        typename iterator_traits<Iterator>::reference ref = *(this->base());
- 
-        switch (ref) {
-            case '\r':
-                if (prev != '\n') {
-                    ++loc.line;
-                    loc.column = 0;
-                }
-                break;
-            case '\n':
-                if (prev != '\r') {
-                    ++loc.line;
-                    loc.column = 0;
-                }
-                break;
-            case '\t':
-                loc.column += TabLength;
-                break;
-            default:
-                ++loc.column;
-                break;
-        }
- 
-        prev = ref;
+        ++pos;
         ++this->base_reference();
     }
  
-    source_location loc;
-    typename boost::detail::iterator_traits<Iterator>::value_type prev;
+    boost::uint32_t pos;
 };
 
 template<class Iterator>
 inline source_location get_location(Iterator const& i)
 {
-    return source_location(-1, -1);
+    return source_location();
 }
  
 template<class Iterator>
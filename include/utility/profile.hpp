@@ -0,0 +1,56 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <iosfwd>
+#include <string>
+
+#include <boost/utility.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace carto {
+
+// Wall time per compile phase and input file, and counts of the work the
+// compiler did, for carto --profile. The profile is process wide so the
+// parsers can report to it without a handle being passed down to them,
+// and safe to report to from the stylesheet loader's threads. Until it is
+// enabled every call returns straight away.
+class profiler {
+
+public:
+    enum counter {
+        annotated_nodes,
+        variables_defined,
+        variable_lookups,
+        filters_generated,
+        rules_emitted,
+        symbolizers_created,
+        expressions_parsed,
+        counter_count
+    };
+
+    static void enable();
+    static bool enabled();
+
+    static void count(counter c, std::size_t n = 1);
+    static void record(std::string const& phase, std::string const& input, double seconds);
+
+    // phases in the order they first finished, their totals and the counters
+    static void write_json(std::ostream& out);
+
+    // adds the time until it goes out of scope to a phase
+    class timer : private boost::noncopyable {
+
+    public:
+        timer(char const* phase_, std::string const& input_);
+        ~timer();
+
+    private:
+        char const* phase;
+        std::string input;
+        boost::posix_time::ptime start;
+    };
+};
+
+}
+
+#endif
@@ -1,34 +1,50 @@
 /*==============================================================================
     Copyright (c) 2001-2011 Joel de Guzman
     Copyright (c) 2010      Bryce Lelbach
- 
+
     Distributed under the Boost Software License, Version 1.0. (See accompanying
     file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 ==============================================================================*/
 
 #include <string>
 
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
 #ifndef MAPNIK_SOURCE_LOCATION_H
 #define MAPNIK_SOURCE_LOCATION_H
- 
+
 namespace carto {
- 
+
+class line_index;
+
+// A byte offset into a source text. Line and column are looked up in the
+// text's line index when they are asked for; a location without an index
+// (e.g. one taken from an iterator during parsing) only knows its offset.
 struct source_location
-{ 
-    int line;
-    int column;
- 
-    source_location (int l, int c);
- 
+{
+    static boost::uint32_t const npos = 0xffffffffu;
+
+    boost::uint32_t offset;
+    boost::shared_ptr<line_index const> lines;
+
+    explicit source_location (boost::uint32_t o);
+
+    source_location (boost::uint32_t o, boost::shared_ptr<line_index const> const& l);
+
     source_location ();
- 
-    bool valid();
-    
-    std::string get_string();
-    
-    bool operator==(source_location const& other) const;   
+
+    bool valid() const;
+
+    int line() const;
+
+    int column() const;
+
+    std::string get_string() const;
+
+    bool operator==(source_location const& other) const;
 };
- 
+
 }
- 
+
 #endif
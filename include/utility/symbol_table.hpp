@@ -0,0 +1,55 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/spirit/include/support_utree.hpp>
+
+namespace carto {
+
+typedef unsigned symbol_id;
+
+// Maps names to dense integer ids. Lookups hash the characters in place
+// (open addressing, no temporary strings), so a symbol node from the parse
+// tree can be resolved without building a std::string first. Names are
+// never moved once interned, so references returned by name() stay valid.
+class symbol_table {
+
+public:
+    symbol_table();
+
+    symbol_id intern(char const* begin, char const* end);
+    symbol_id intern(std::string const& name);
+    
+    // accepts a symbol or string node, or a list holding a single one
+    symbol_id intern(boost::spirit::utree const& name);
+
+    // looks a name up without adding it
+    bool find(char const* begin, char const* end, symbol_id& id) const;
+
+    std::string const& name(symbol_id id) const;
+    std::size_t size() const;
+
+private:
+    static std::size_t hash(char const* begin, char const* end);
+    void grow();
+
+    static symbol_id const empty = symbol_id(-1);
+
+    std::deque<std::string> names_;
+    std::vector<symbol_id> slots_;
+};
+
+// The table that parse trees and environments intern into, shared by the
+// whole process so an id stored on a node means the same name in every
+// environment. It is locked: parse trees intern their names once, when they
+// are finalized, and lookups with those ids don't come here.
+symbol_id intern_symbol(std::string const& name);
+symbol_id intern_symbol(boost::spirit::utree const& name);
+std::string const& symbol_name(symbol_id id);
+
+}
+
+#endif
@@ -3,6 +3,8 @@
 
 #include <string>
 
+#define CARTO_PARSER_VERSION "0.0.0"
+
 bool version_from_string(std::string min_version_string);
 
 #endif
@@ -0,0 +1,365 @@
+/*==============================================================================
+    Copyright (c) 2010 Bryce Lelbach
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file BOOST_LICENSE_1_0.rst or copy at http://www.boost.org/LICENSE_1_0.txt)
+==============================================================================*/
+
+#include <parse/annotation_table.hpp>
+#include <utility/carto_error.hpp>
+#include <utility/profile.hpp>
+
+#include <algorithm>
+
+#include <boost/assert.hpp>
+#include <boost/make_shared.hpp>
+
+namespace carto {
+
+using boost::spirit::utree_type;
+
+namespace {
+
+std::size_t const tag_mask = 0xffff;
+
+// layout of a finalized tag: the type + 1, then the symbol id + 1 of a name
+unsigned const type_bits   = 5,
+               type_mask   = (1 << type_bits) - 1;
+symbol_id const max_symbol = tag_mask >> type_bits;
+
+int finalized_type(utree const& ut)
+{
+    unsigned type = (unsigned short) ut.tag() & type_mask;
+
+    return type == 0 ? 0 : type - 1;
+}
+
+// a name is a symbol, or a list holding one
+short finalized_tag(utree const& ut, int type, bool is_name)
+{
+    BOOST_ASSERT(type >= 0 && unsigned(type) < type_mask);
+
+    unsigned tag = type + 1;
+    utree const* name = &ut;
+
+    if (ut.which() == utree_type::list_type && ut.size() == 1)
+        name = &ut.front();
+
+    if (is_name && name->which() == utree_type::symbol_type) {
+        symbol_id id = intern_symbol(*name);
+
+        if (id < max_symbol)
+            tag |= (id + 1) << type_bits;
+    }
+
+    return (short) tag;
+}
+
+template<class Visitor>
+void walk_post_order(utree& ut, Visitor& v)
+{
+    if (ut.which() == utree_type::list_type) {
+        utree::iterator it  = ut.begin(),
+                        end = ut.end();
+        for (; it != end; ++it)
+            walk_post_order(*it, v);
+    }
+
+    if (ut.tag() != 0)
+        v(ut);
+}
+
+template<class Visitor>
+void walk_post_order(utree const& ut, Visitor& v)
+{
+    if (ut.which() == utree_type::list_type) {
+        utree::const_iterator it  = ut.begin(),
+                              end = ut.end();
+        for (; it != end; ++it)
+            walk_post_order(*it, v);
+    }
+
+    if (ut.tag() != 0)
+        v(ut);
+}
+
+}
+
+struct annotation_table_finalizer {
+    annotation_table& table;
+    std::size_t last;
+    std::size_t visited;
+
+    annotation_table_finalizer(annotation_table& table_)
+      : table(table_), last(0), visited(0) { }
+
+    void operator() (utree& ut)
+    {
+        // smallest index >= the previous one with the same low bits
+        std::size_t low  = (unsigned short) ut.tag(),
+                    full = (last & ~tag_mask) | low;
+
+        if (full < last)
+            full += tag_mask + 1;
+
+        if (full >= table.pushed_)
+            throw carto_error("Inconsistent parse tree annotations");
+
+        last = full;
+        ++visited;
+
+        annotation_table::block const* b = table.blocks_[full >> annotation_table::block_bits];
+        std::size_t i = full & (annotation_table::block_size - 1);
+
+        annotation_table::node_location loc;
+        loc.node   = &ut;
+        loc.offset = b->offset[i];
+        table.index_.push_back(loc);
+
+        int type = b->type[i];
+        ut.tag(finalized_tag(ut, type & ~annotation_table::name_flag,
+                             (type & annotation_table::name_flag) != 0));
+    }
+};
+
+struct annotation_table_collector {
+    annotation_table const& table;
+    std::vector<boost::uint32_t>& offsets;
+
+    annotation_table_collector(annotation_table const& table_, std::vector<boost::uint32_t>& offsets_)
+      : table(table_), offsets(offsets_) { }
+
+    void operator() (utree const& ut)
+    {
+        offsets.push_back(table.location(ut).offset);
+    }
+};
+
+struct annotation_table_restorer {
+    std::vector<annotation_table::node_location>& index;
+    std::vector<boost::uint32_t> const& offsets;
+    std::size_t next;
+
+    annotation_table_restorer(std::vector<annotation_table::node_location>& index_,
+                              std::vector<boost::uint32_t> const& offsets_)
+      : index(index_), offsets(offsets_), next(0) { }
+
+    void operator() (utree& ut)
+    {
+        if (next == offsets.size())
+            throw carto_error("Inconsistent parse tree annotations");
+
+        annotation_table::node_location loc;
+        loc.node   = &ut;
+        loc.offset = offsets[next];
+        index.push_back(loc);
+
+        // ids are only valid in the process that interned them
+        symbol_id id;
+        ut.tag(finalized_tag(ut, finalized_type(ut), annotation_table::symbol(ut, id)));
+
+        ++next;
+    }
+};
+
+struct annotation_table_eraser {
+    std::vector<utree const*>& nodes;
+
+    annotation_table_eraser(std::vector<utree const*>& nodes_)
+      : nodes(nodes_) { }
+
+    void operator() (utree const& ut)
+    {
+        nodes.push_back(&ut);
+    }
+};
+
+annotation_table::annotation_table()
+  : blocks_(),
+    pushed_(0),
+    index_(),
+    lines_(boost::make_shared<line_index>()) { }
+
+annotation_table::~annotation_table()
+{
+    release_blocks();
+}
+
+std::size_t annotation_table::push(source_location const& loc, int type)
+{
+    // an index whose low bits are 0 would read as an untagged node
+    if ((pushed_ & tag_mask) == 0)
+        append(source_location(), 0);
+
+    return append(loc, type);
+}
+
+std::size_t annotation_table::append(source_location const& loc, int type)
+{
+    std::size_t b = pushed_ >> block_bits,
+                i = pushed_ & (block_size - 1);
+
+    if (b == blocks_.size())
+        blocks_.push_back(new block);
+
+    blocks_[b]->offset[i] = loc.offset;
+    blocks_[b]->type[i]   = type;
+
+    return pushed_++;
+}
+
+short annotation_table::tag(std::size_t index)
+{
+    return (short) (index & tag_mask);
+}
+
+void annotation_table::reserve(std::size_t n)
+{
+    std::size_t needed = (n + block_size - 1) >> block_bits;
+
+    blocks_.reserve(needed);
+    while (blocks_.size() < needed)
+        blocks_.push_back(new block);
+}
+
+void annotation_table::finalize(utree& ast)
+{
+    index_.clear();
+    index_.reserve(pushed_);
+
+    annotation_table_finalizer finalizer(*this);
+    walk_post_order(ast, finalizer);
+
+    // A recovered index is never larger than the real one, and once it
+    // falls short by a multiple of the tag range it never catches up. So
+    // if the last node is less than a tag range from the end no node was
+    // matched to the wrong entry; otherwise one might have been, after
+    // that many discarded annotations between two nodes.
+    if (finalizer.visited != 0 && pushed_ - finalizer.last > tag_mask + 1)
+        throw carto_error("Too many discarded parse tree annotations to recover source locations");
+
+    std::sort(index_.begin(), index_.end());
+    release_blocks();
+
+    profiler::count(profiler::annotated_nodes, index_.size());
+}
+
+std::size_t annotation_table::estimate(std::size_t input_size)
+{
+    return input_size / 8;
+}
+
+int annotation_table::type(utree const& ut) const
+{
+    return finalized_type(ut);
+}
+
+bool annotation_table::symbol(utree const& ut, symbol_id& id)
+{
+    unsigned stored = (unsigned short) ut.tag() >> type_bits;
+
+    if (stored == 0)
+        return false;
+
+    id = stored - 1;
+    return true;
+}
+
+source_location annotation_table::location(utree const& ut) const
+{
+    node_location key;
+    key.node = &ut;
+
+    std::vector<node_location>::const_iterator it 
+        = std::lower_bound(index_.begin(), index_.end(), key);
+
+    if (it == index_.end() || it->node != &ut)
+        return source_location();
+
+    return source_location(it->offset, lines_);
+}
+
+std::size_t annotation_table::size() const
+{
+    return index_.size();
+}
+
+void annotation_table::clear()
+{
+    release_blocks();
+    index_.clear();
+}
+
+boost::shared_ptr<line_index const> const& annotation_table::lines() const
+{
+    return lines_;
+}
+
+void annotation_table::set_lines(boost::shared_ptr<line_index const> const& lines)
+{
+    lines_ = lines;
+}
+
+std::vector<boost::uint32_t> annotation_table::offsets(utree const& ast) const
+{
+    std::vector<boost::uint32_t> offsets;
+    offsets.reserve(index_.size());
+
+    annotation_table_collector collector(*this, offsets);
+    walk_post_order(ast, collector);
+
+    return offsets;
+}
+
+void annotation_table::restore(utree& ast, std::vector<boost::uint32_t> const& offsets)
+{
+    clear();
+    index_.reserve(offsets.size());
+
+    annotation_table_restorer restorer(index_, offsets);
+    walk_post_order(ast, restorer);
+
+    std::sort(index_.begin(), index_.end());
+}
+
+void annotation_table::erase(std::vector<utree const*> const& roots)
+{
+    std::vector<utree const*> nodes;
+
+    annotation_table_eraser eraser(nodes);
+    for (std::size_t i = 0; i != roots.size(); ++i)
+        walk_post_order(*roots[i], eraser);
+
+    std::sort(nodes.begin(), nodes.end());
+
+    // both sides are sorted by address, keep the entries not in nodes
+    std::vector<node_location>::iterator out = index_.begin();
+    std::vector<utree const*>::const_iterator it  = nodes.begin(),
+                                              end = nodes.end();
+
+    for (std::size_t i = 0; i != index_.size(); ++i) {
+        while (it != end && *it < index_[i].node)
+            ++it;
+
+        if (it == end || *it != index_[i].node)
+            *out++ = index_[i];
+    }
+
+    index_.erase(out, index_.end());
+}
+
+void annotation_table::set_type(utree& ut, int type) const
+{
+    ut.tag(finalized_tag(ut, type, false));
+}
+
+void annotation_table::release_blocks()
+{
+    for (std::size_t i = 0; i != blocks_.size(); ++i)
+        delete blocks_[i];
+
+    blocks_.clear();
+    pushed_ = 0;
+}
+
+}
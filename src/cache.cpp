@@ -0,0 +1,402 @@
+/*==============================================================================
+    Copyright (c) 2010 Colin Rundel
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file BOOST_LICENSE_1_0.rst or copy at http://www.boost.org/LICENSE_1_0.txt)
+==============================================================================*/
+
+#include <cache.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <boost/assert.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <mapnik/version.hpp>
+
+#include <parse/parse_tree.hpp>
+#include <utility/utree.hpp>
+#include <utility/version.hpp>
+#include <utility/carto_error.hpp>
+#include <utility/mapped_file.hpp>
+
+namespace carto {
+
+namespace fs = boost::filesystem;
+
+using spirit::utree_type;
+
+namespace {
+
+std::string const cache_salt = std::string("carto ") + CARTO_PARSER_VERSION
+                             + " mapnik " + boost::lexical_cast<std::string>(MAPNIK_VERSION)
+                             + " cache 6";
+
+char const tree_magic[] = "carto-tree";
+
+// the line at it without its newline, false if there is no whole line left
+bool read_line(char const*& it, char const* end, std::string& line)
+{
+    char const* eol = std::find(it, end, '\n');
+
+    if (eol == end)
+        return false;
+
+    line.assign(it, eol);
+    it = eol + 1;
+    return true;
+}
+
+struct tree_writer {
+    std::string& out;
+
+    tree_writer(std::string& out_)
+      : out(out_) { }
+
+    template<class T>
+    void write(T val)
+    {
+        out.append(reinterpret_cast<char const*>(&val), sizeof(T));
+    }
+
+    template<class Range>
+    void write_range(Range const& rng)
+    {
+        write<boost::uint32_t>(rng.end() - rng.begin());
+        out.append(rng.begin(), rng.end());
+    }
+
+    void write(utree const& ut)
+    {
+        write<boost::uint8_t>(ut.which());
+        write<boost::int16_t>(ut.tag());
+
+        switch (ut.which()) {
+            case utree_type::invalid_type:
+            case utree_type::nil_type:
+                break;
+            case utree_type::bool_type:
+                write<boost::uint8_t>(ut.get<bool>());
+                break;
+            case utree_type::int_type:
+                write<boost::int32_t>(ut.get<int>());
+                break;
+            case utree_type::double_type:
+                write<double>(ut.get<double>());
+                break;
+            case utree_type::string_type:
+                write_range(ut.get<spirit::utf8_string_range_type>());
+                break;
+            case utree_type::symbol_type:
+                write_range(ut.get<spirit::utf8_symbol_range_type>());
+                break;
+            case utree_type::binary_type:
+                write_range(ut.get<spirit::binary_range_type>());
+                break;
+            case utree_type::list_type:
+            {
+                write<boost::uint32_t>(ut.size());
+
+                utree::const_iterator it  = ut.begin(),
+                                      end = ut.end();
+                for (; it != end; ++it)
+                    write(*it);
+                break;
+            }
+            default:
+                throw carto_error("Cannot cache parse tree node of this type");
+        }
+    }
+};
+
+struct tree_reader {
+    char const* it;
+    char const* end;
+
+    tree_reader(char const* begin_, char const* end_)
+      : it(begin_), end(end_) { }
+
+    template<class T>
+    T read()
+    {
+        if (std::size_t(end - it) < sizeof(T))
+            throw carto_error("Truncated cache entry");
+
+        T val;
+        std::memcpy(&val, it, sizeof(T));
+        it += sizeof(T);
+        return val;
+    }
+
+    std::string read_string()
+    {
+        boost::uint32_t n = read<boost::uint32_t>();
+
+        if (std::size_t(end - it) < n)
+            throw carto_error("Truncated cache entry");
+
+        std::string str(it, it + n);
+        it += n;
+        return str;
+    }
+
+    utree read_utree()
+    {
+        int which = read<boost::uint8_t>();
+        short tag = read<boost::int16_t>();
+
+        utree ut;
+
+        switch (which) {
+            case utree_type::invalid_type:
+                break;
+            case utree_type::nil_type:
+                ut = utree::nil_type();
+                break;
+            case utree_type::bool_type:
+                ut = bool(read<boost::uint8_t>());
+                break;
+            case utree_type::int_type:
+                ut = int(read<boost::int32_t>());
+                break;
+            case utree_type::double_type:
+                ut = read<double>();
+                break;
+            case utree_type::string_type:
+                ut = spirit::utf8_string_type(read_string());
+                break;
+            case utree_type::symbol_type:
+                ut = spirit::utf8_symbol_type(read_string());
+                break;
+            case utree_type::binary_type:
+                ut = spirit::binary_string_type(read_string());
+                break;
+            case utree_type::list_type:
+            {
+                boost::uint32_t n = read<boost::uint32_t>();
+
+                ut = utree::list_type();
+                for (boost::uint32_t i = 0; i != n; ++i)
+                    ut.push_back(read_utree());
+                break;
+            }
+            default:
+                throw carto_error("Corrupt cache entry");
+        }
+
+        ut.tag(tag);
+        return ut;
+    }
+};
+
+}
+
+compile_cache::compile_cache(std::string const& dir_)
+  : dir(dir_)
+{
+    boost::system::error_code ec;
+    fs::create_directories(fs::path(dir), ec);
+
+    if (ec)
+        throw carto_error("Cannot create cache directory: " + dir);
+}
+
+std::string compile_cache::hash(char const* begin, char const* end)
+{
+    // 64-bit FNV-1a, seeded with the compiler version so entries written by
+    // an older build are never picked up
+    boost::uint64_t h = 14695981039346656037ULL;
+
+    for (std::string::const_iterator it = cache_salt.begin(); it != cache_salt.end(); ++it) {
+        h ^= (unsigned char) *it;
+        h *= 1099511628211ULL;
+    }
+
+    for (; begin != end; ++begin) {
+        h ^= (unsigned char) *begin;
+        h *= 1099511628211ULL;
+    }
+
+    std::ostringstream out;
+    out.width(16);
+    out.fill('0');
+    out << std::hex << h;
+    return out.str();
+}
+
+std::string compile_cache::hash(std::string const& str)
+{
+    return hash(str.data(), str.data() + str.size());
+}
+
+std::string compile_cache::hash_file(std::string const& filename)
+{
+    mapped_file file(filename);
+    return hash(file.begin(), file.end());
+}
+
+std::string compile_cache::entry(std::string const& prefix, std::string const& key,
+                                 std::string const& ext) const
+{
+    return (fs::path(dir) / (prefix + "-" + key + ext)).string();
+}
+
+std::string compile_cache::map_key(std::string const& input, std::string const& options) const
+{
+    std::string abs = fs::absolute(fs::path(input)).string();
+
+    return hash(abs + '\0' + options);
+}
+
+void compile_cache::write_file(std::string const& filename, std::string const& data) const
+{
+    // write under a unique name and rename into place so concurrent writers
+    // and interrupted runs never leave a partial entry behind
+    fs::path tmp = fs::path(filename).parent_path() / fs::unique_path(".tmp-%%%%-%%%%-%%%%");
+
+    {
+        std::ofstream file(tmp.string().c_str(), std::ios::out | std::ios::binary);
+        if (!file)
+            return;
+
+        file.write(data.data(), data.size());
+    }
+
+    boost::system::error_code ec;
+    if (fs::file_size(tmp, ec) != data.size()) {
+        fs::remove(tmp, ec);
+        return;
+    }
+
+    fs::rename(tmp, fs::path(filename), ec);
+    if (ec)
+        fs::remove(tmp, ec);
+}
+
+boost::optional<parse_tree> compile_cache::load_tree(std::string const& key) const
+{
+    std::string filename = entry("tree", key, ".bin");
+
+    if (!fs::exists(fs::path(filename)))
+        return boost::optional<parse_tree>();
+
+    try {
+        mapped_file file(filename);
+        tree_reader in(file.begin(), file.end());
+
+        if (in.read_string() != tree_magic)
+            return boost::optional<parse_tree>();
+
+        parse_tree pt;
+        pt.ast() = in.read_utree();
+
+        // node types travel in the tags, offsets follow in post-order
+        boost::uint32_t n = in.read<boost::uint32_t>();
+
+        std::vector<boost::uint32_t> offsets;
+        offsets.reserve(n);
+
+        for (boost::uint32_t i = 0; i != n; ++i)
+            offsets.push_back(in.read<boost::uint32_t>());
+
+        pt.annotations().restore(pt.ast(), offsets);
+
+        return pt;
+    } catch (carto_error&) {
+        return boost::optional<parse_tree>();
+    }
+}
+
+void compile_cache::store_tree(std::string const& key, parse_tree const& pt) const
+{
+    std::string data;
+    tree_writer out(data);
+
+    try {
+        out.write_range(std::string(tree_magic));
+        out.write(pt.ast());
+
+        std::vector<boost::uint32_t> offsets = pt.annotations().offsets(pt.ast());
+        out.write<boost::uint32_t>(offsets.size());
+
+        for (std::size_t i = 0; i != offsets.size(); ++i)
+            out.write<boost::uint32_t>(offsets[i]);
+    } catch (carto_error&) {
+        return;
+    }
+
+    write_file(entry("tree", key, ".bin"), data);
+}
+
+boost::optional<std::string> compile_cache::load_map(std::string const& input, std::string const& options) const
+{
+    std::string filename = entry("map", map_key(input, options), ".map");
+
+    if (!fs::exists(fs::path(filename)))
+        return boost::optional<std::string>();
+
+    try {
+        mapped_file file(filename);
+        char const* it  = file.begin();
+        char const* end = file.end();
+
+        // the number of inputs, a line "<hash> <path>" for each and then
+        // the xml; the entry is stale as soon as any input hashes
+        // differently or has disappeared
+        std::string line;
+
+        if (!read_line(it, end, line))
+            return boost::optional<std::string>();
+
+        std::size_t deps = boost::lexical_cast<std::size_t>(line);
+
+        for (std::size_t i = 0; i != deps; ++i) {
+            if (!read_line(it, end, line))
+                return boost::optional<std::string>();
+
+            std::string::size_type space = line.find(' ');
+
+            if (space == std::string::npos
+                || hash_file(line.substr(space + 1)) != line.substr(0, space))
+                return boost::optional<std::string>();
+        }
+
+        return std::string(it, end);
+    } catch (carto_error&) {
+        return boost::optional<std::string>();
+    } catch (boost::bad_lexical_cast&) {
+        return boost::optional<std::string>();
+    }
+}
+
+void compile_cache::store_map(std::string const& input, std::vector<std::string> const& deps,
+                              std::vector<std::string> const& hashes,
+                              std::string const& xml, std::string const& options) const
+{
+    BOOST_ASSERT(deps.size() == hashes.size());
+
+    std::ostringstream data;
+    data << deps.size() << "\n";
+
+    for (std::size_t i = 0; i != deps.size(); ++i) {
+        // an input that was not read from its file has nothing to vouch
+        // for the output
+        if (hashes[i].empty())
+            return;
+
+        data << hashes[i] << " " << fs::absolute(fs::path(deps[i])).string() << "\n";
+    }
+
+    data << xml;
+
+    // the manifest and the xml are renamed into place together, so they
+    // always come from the same run
+    write_file(entry("map", map_key(input, options), ".map"), data.str());
+}
+
+}
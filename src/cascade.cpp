@@ -0,0 +1,475 @@
+#include <cascade.hpp>
+
+#include <algorithm>
+#include <queue>
+#include <sstream>
+
+#include <boost/make_shared.hpp>
+
+#include <generate/generate_filter.hpp>
+#include <generate/normalize_filter.hpp>
+#include <selector_index.hpp>
+
+namespace carto {
+
+namespace {
+
+// definitions of a style with the same filter and scale range
+struct rule_group {
+    std::vector<std::string> terms;
+    double min_scale;
+    double max_scale;
+    std::vector<std::size_t> members;
+    std::size_t most_specific;
+};
+
+typedef boost::unordered_map< std::string, std::vector<std::size_t> > group_map;
+
+// beyond this many conditions the subsets of a rule are not enumerated,
+// its broader rules are searched for among all rules instead
+std::size_t const max_subset_terms = 8;
+
+std::string terms_key(std::vector<std::string> const& terms)
+{
+    std::ostringstream key;
+
+    for (std::size_t i = 0; i != terms.size(); ++i)
+        key << terms[i].size() << ':' << terms[i];
+
+    return key.str();
+}
+
+// the keys of all subsets of a rule's conditions, if there are few enough
+// of them to enumerate
+bool subset_keys(std::vector<std::string> const& terms, std::vector<std::string>& keys)
+{
+    if (terms.size() > max_subset_terms)
+        return false;
+
+    std::size_t const subsets = std::size_t(1) << terms.size();
+
+    for (std::size_t mask = 0; mask != subsets; ++mask) {
+        std::vector<std::string> subset;
+
+        for (std::size_t t = 0; t != terms.size(); ++t) {
+            if (mask & (std::size_t(1) << t))
+                subset.push_back(terms[t]);
+        }
+
+        keys.push_back(terms_key(subset));
+    }
+
+    return true;
+}
+
+bool within(rule_group const& broad, rule_group const& narrow)
+{
+    return broad.min_scale <= narrow.min_scale && narrow.max_scale <= broad.max_scale;
+}
+
+bool empty_range(rule_group const& group)
+{
+    return group.min_scale >= group.max_scale;
+}
+
+// the group with these conditions and scale range, added if there is none
+std::size_t find_group(std::vector<rule_group>& groups, group_map& by_terms,
+                       std::vector<std::string> const& terms, double min_scale, double max_scale,
+                       std::size_t most_specific)
+{
+    std::vector<std::size_t>& candidates = by_terms[terms_key(terms)];
+
+    for (std::size_t c = 0; c != candidates.size(); ++c) {
+        rule_group const& group = groups[candidates[c]];
+
+        if (group.min_scale == min_scale && group.max_scale == max_scale)
+            return candidates[c];
+    }
+
+    rule_group group;
+    group.terms = terms;
+    group.min_scale = min_scale;
+    group.max_scale = max_scale;
+    group.most_specific = most_specific;
+
+    candidates.push_back(groups.size());
+    groups.push_back(group);
+
+    return groups.size() - 1;
+}
+
+// every group whose conditions are a subset of those of group, whatever
+// their scale range, group itself included
+void subset_groups(rule_group const& group, std::vector<rule_group> const& groups,
+                   group_map const& by_terms, std::vector<std::size_t>& subsets)
+{
+    std::vector<std::string> keys;
+
+    if (subset_keys(group.terms, keys)) {
+        for (std::size_t k = 0; k != keys.size(); ++k) {
+            group_map::const_iterator it = by_terms.find(keys[k]);
+
+            if (it != by_terms.end())
+                subsets.insert(subsets.end(), it->second.begin(), it->second.end());
+        }
+    } else {
+        for (std::size_t b = 0; b != groups.size(); ++b) {
+            if (std::includes(group.terms.begin(), group.terms.end(),
+                              groups[b].terms.begin(), groups[b].terms.end()))
+                subsets.push_back(b);
+        }
+    }
+}
+
+bool within(rule_builder const& broad, rule_builder const& narrow)
+{
+    return broad.get_min_scale() <= narrow.get_min_scale() && narrow.get_max_scale() <= broad.get_max_scale();
+}
+
+bool same_declarations(cascade::resolved_rule const& a, cascade::resolved_rule const& b)
+{
+    if (a.declarations.size() != b.declarations.size())
+        return false;
+
+    for (std::size_t d = 0; d != a.declarations.size(); ++d) {
+        if (a.declarations[d]->prop != b.declarations[d]->prop
+            || !(a.declarations[d]->value == b.declarations[d]->value))
+            return false;
+    }
+
+    return true;
+}
+
+// whether b can be folded into a, the rule before it: same conditions,
+// same declarations and scale ranges that meet
+bool mergeable(cascade::resolved_rule const& a, cascade::resolved_rule const& b)
+{
+    rule_builder const& ra = a.rule;
+    rule_builder const& rb = b.rule;
+
+    return a.terms == b.terms
+        && (ra.get_max_scale() == rb.get_min_scale() || rb.get_max_scale() == ra.get_min_scale())
+        && same_declarations(a, b);
+}
+
+struct by_specificity {
+    std::vector<definition> const& defs;
+
+    by_specificity(std::vector<definition> const& defs_)
+      : defs(defs_) { }
+
+    bool operator() (std::size_t a, std::size_t b) const
+    {
+        return defs[a].spec < defs[b].spec;
+    }
+};
+
+struct less_specific_group {
+    std::vector<definition> const& defs;
+    std::vector<rule_group> const& groups;
+
+    less_specific_group(std::vector<definition> const& defs_, std::vector<rule_group> const& groups_)
+      : defs(defs_), groups(groups_) { }
+
+    bool operator() (std::size_t a, std::size_t b) const
+    {
+        specificity const& sa = defs[groups[a].most_specific].spec;
+        specificity const& sb = defs[groups[b].most_specific].spec;
+
+        // the pieces of a split group go out in the order they were cut
+        if (!(sa < sb) && !(sb < sa))
+            return b < a;
+
+        return sa < sb;
+    }
+};
+
+// Cuts the scale range of each group at the bounds of the groups with a
+// subset of its conditions that fall inside it, so that every piece lies
+// either within the range of such a group or outside it and a piece
+// inside it can take its declarations. Pieces with the same conditions
+// and range become one group, of the members of both.
+void split_groups(std::vector<definition> const& defs,
+                  std::vector<rule_group>& groups, group_map& by_terms)
+{
+    std::vector<rule_group> pieces;
+    group_map pieces_by_terms;
+
+    for (std::size_t g = 0; g != groups.size(); ++g) {
+        rule_group const& group = groups[g];
+
+        std::vector<double> bounds(1, group.min_scale);
+
+        if (!empty_range(group)) {
+            std::vector<std::size_t> subsets;
+            subset_groups(group, groups, by_terms, subsets);
+
+            for (std::size_t s = 0; s != subsets.size(); ++s) {
+                rule_group const& broad = groups[subsets[s]];
+
+                // a range with the same conditions inside the group's own
+                // already takes its declarations
+                if (empty_range(broad) || (broad.terms == group.terms && within(group, broad)))
+                    continue;
+
+                if (group.min_scale < broad.min_scale && broad.min_scale < group.max_scale)
+                    bounds.push_back(broad.min_scale);
+                if (group.min_scale < broad.max_scale && broad.max_scale < group.max_scale)
+                    bounds.push_back(broad.max_scale);
+            }
+
+            std::sort(bounds.begin(), bounds.end());
+            bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+        }
+
+        bounds.push_back(group.max_scale);
+
+        for (std::size_t b = 0; b + 1 != bounds.size(); ++b) {
+            rule_group& piece = pieces[find_group(pieces, pieces_by_terms, group.terms,
+                                                  bounds[b], bounds[b + 1], group.most_specific)];
+
+            piece.members.insert(piece.members.end(), group.members.begin(), group.members.end());
+
+            if (defs[piece.most_specific].spec < defs[group.most_specific].spec)
+                piece.most_specific = group.most_specific;
+        }
+    }
+
+    groups.swap(pieces);
+    by_terms.swap(pieces_by_terms);
+}
+
+}
+
+specificity::specificity()
+  : ids(0), classes(0), filters(0), index(0) { }
+
+specificity::specificity(std::string const& style_name, unsigned filters_, unsigned index_)
+  : ids(0), classes(0), filters(filters_), index(index_)
+{
+    selector_index::selectors tokens = selector_index::split(style_name);
+
+    for (std::size_t i = 0; i != tokens.size(); ++i) {
+        if (tokens[i].empty() || tokens[i] == "*")
+            continue;
+
+        if (tokens[i][0] == '#')
+            ++ids;
+        else
+            ++classes;
+    }
+}
+
+bool specificity::operator<(specificity const& other) const
+{
+    if (ids != other.ids)
+        return ids < other.ids;
+    if (classes != other.classes)
+        return classes < other.classes;
+    if (filters != other.filters)
+        return filters < other.filters;
+
+    return index < other.index;
+}
+
+void cascade::add(std::string const& style, definition const& def)
+{
+    std::vector<definition>& defs = definitions_[style];
+
+    if (defs.empty())
+        styles_.push_back(style);
+
+    defs.push_back(def);
+}
+
+std::vector<std::string> const& cascade::styles() const
+{
+    return styles_;
+}
+
+void cascade::resolve(std::string const& style, std::vector<resolved_rule>& rules) const
+{
+    definition_map::const_iterator found = definitions_.find(style);
+
+    if (found == definitions_.end())
+        return;
+
+    std::vector<definition> const& defs = found->second;
+
+    std::vector<rule_group> groups;
+    group_map by_terms;
+
+    // group the definitions by their conditions and scale range
+    for (std::size_t i = 0; i != defs.size(); ++i) {
+        rule_builder const& rule = defs[i].rule;
+
+        std::vector<std::string> terms;
+        defs[i].filter.terms(terms);
+
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+        rule_group& group = groups[find_group(groups, by_terms, terms,
+                                              rule.get_min_scale(), rule.get_max_scale(), i)];
+
+        group.members.push_back(i);
+
+        if (defs[group.most_specific].spec < defs[i].spec)
+            group.most_specific = i;
+    }
+
+    // e.g. #a[x=1] and #a[zoom>=12]: [x]=1 is split at zoom 12, and the
+    // piece from zoom 12 on takes the declarations of both
+    split_groups(defs, groups, by_terms);
+
+    // every group at least as broad as each group, itself included
+    std::vector< std::vector<std::size_t> > broader(groups.size());
+
+    // the number of narrower groups of each group not emitted yet
+    std::vector<std::size_t> narrower(groups.size(), 0);
+
+    for (std::size_t g = 0; g != groups.size(); ++g) {
+        std::vector<std::size_t> subsets;
+        subset_groups(groups[g], groups, by_terms, subsets);
+
+        for (std::size_t s = 0; s != subsets.size(); ++s) {
+            if (within(groups[subsets[s]], groups[g]))
+                broader[g].push_back(subsets[s]);
+        }
+
+        for (std::size_t b = 0; b != broader[g].size(); ++b) {
+            if (broader[g][b] != g)
+                ++narrower[broader[g][b]];
+        }
+    }
+
+    // A feature gets the first rule that matches it, so a rule goes after
+    // every rule narrower than it, which it would otherwise hide. Among the
+    // rules whose narrower rules are all out, the most specific goes first.
+    std::priority_queue<std::size_t, std::vector<std::size_t>, less_specific_group>
+        ready(less_specific_group(defs, groups));
+
+    for (std::size_t g = 0; g != groups.size(); ++g) {
+        if (narrower[g] == 0)
+            ready.push(g);
+    }
+
+    while (!ready.empty()) {
+        std::size_t g = ready.top();
+        ready.pop();
+
+        rule_group const& group = groups[g];
+
+        for (std::size_t b = 0; b != broader[g].size(); ++b) {
+            if (broader[g][b] != g && --narrower[broader[g][b]] == 0)
+                ready.push(broader[g][b]);
+        }
+
+        std::vector<std::size_t> contributing;
+
+        for (std::size_t b = 0; b != broader[g].size(); ++b) {
+            std::vector<std::size_t> const& members = groups[broader[g][b]].members;
+            contributing.insert(contributing.end(), members.begin(), members.end());
+        }
+
+        std::sort(contributing.begin(), contributing.end(), by_specificity(defs));
+
+        definition const& most_specific = defs[group.most_specific];
+
+        resolved_rule resolved;
+        resolved.rule = most_specific.rule;
+        resolved.rule.set_min_scale(group.min_scale);
+        resolved.rule.set_max_scale(group.max_scale);
+        resolved.terms = group.terms;
+
+        if (!most_specific.filter.empty())
+            resolved.rule.set_filter(boost::make_shared<mapnik::expr_node>(most_specific.filter.build()));
+
+        for (std::size_t c = 0; c != contributing.size(); ++c) {
+            std::vector<declaration> const& decls = defs[contributing[c]].declarations;
+
+            resolved.sources.push_back(&defs[contributing[c]]);
+
+            for (std::size_t d = 0; d != decls.size(); ++d)
+                resolved.declarations.push_back(&decls[d]);
+        }
+
+        rules.push_back(resolved);
+    }
+}
+
+void cascade::compact(std::vector<resolved_rule>& rules)
+{
+    typedef boost::unordered_map< std::string, std::vector<std::size_t> > rule_map;
+
+    std::vector<resolved_rule> kept;
+
+    // resolve puts every rule before the rules broader than it, so only a
+    // rule widened by a merge can come before a rule it matches every
+    // feature of; those are the only kept rules looked up for shadowing
+    std::vector<std::size_t> widened;
+    rule_map by_terms;
+
+    for (std::size_t r = 0; r != rules.size(); ++r) {
+        resolved_rule const& rule = rules[r];
+
+        // nothing to render, or no zoom level or feature selects it
+        if (rule.declarations.empty() 
+            || rule.rule.get_min_scale() >= rule.rule.get_max_scale()
+            || is_false_filter(*rule.rule.get_filter()))
+            continue;
+
+        // a widened rule matches every feature this one matches, and it
+        // comes first
+        bool shadowed = false;
+        std::vector<std::string> keys;
+
+        if (subset_keys(rule.terms, keys)) {
+            for (std::size_t k = 0; k != keys.size() && !shadowed; ++k) {
+                rule_map::const_iterator it = by_terms.find(keys[k]);
+
+                if (it == by_terms.end())
+                    continue;
+
+                for (std::size_t c = 0; c != it->second.size() && !shadowed; ++c)
+                    shadowed = within(kept[it->second[c]].rule, rule.rule);
+            }
+        } else {
+            for (std::size_t w = 0; w != widened.size() && !shadowed; ++w) {
+                resolved_rule const& broad = kept[widened[w]];
+
+                shadowed = within(broad.rule, rule.rule)
+                        && std::includes(rule.terms.begin(), rule.terms.end(),
+                                         broad.terms.begin(), broad.terms.end());
+            }
+        }
+
+        if (shadowed)
+            continue;
+
+        if (!kept.empty() && mergeable(kept.back(), rule)) {
+            rule_builder& merged = kept.back().rule;
+
+            merged.set_min_scale(std::min(merged.get_min_scale(), rule.rule.get_min_scale()));
+            merged.set_max_scale(std::max(merged.get_max_scale(), rule.rule.get_max_scale()));
+
+            if (widened.empty() || widened.back() != kept.size() - 1) {
+                widened.push_back(kept.size() - 1);
+                by_terms[terms_key(kept.back().terms)].push_back(kept.size() - 1);
+            }
+            continue;
+        }
+
+        kept.push_back(rule);
+    }
+
+    rules.swap(kept);
+}
+
+void cascade::clear()
+{
+    definitions_.clear();
+    styles_.clear();
+}
+
+}
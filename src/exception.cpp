@@ -21,9 +21,13 @@ exception::exception (std::string const& source, source_location loc,
     set(source, loc, exception);
 }
 
-void exception::set (std::string const& source, source_location loc,
+void exception::set (std::string const& source_, source_location loc_,
                      std::string const& exception)
 {
+    source = source_;
+    loc    = loc_;
+    detail = exception;
+    
     msg = "Error in ";
     
     msg += "\"" + source + "\"";
@@ -34,6 +38,14 @@ void exception::set (std::string const& source, source_location loc,
     msg += " " + exception;
 }
 
+void exception::set_lines (boost::shared_ptr<line_index const> const& lines)
+{
+    if (loc.valid() && !loc.lines) {
+        loc.lines = lines;
+        set(source, loc, detail);
+    }
+}
+
 const char* exception::what () const throw() {
     return msg.c_str();
 }
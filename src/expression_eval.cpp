@@ -8,18 +8,19 @@ namespace carto {
 
 using boost::spirit::utree_type;
 
-utree expression::eval_var(utree const& node)
+utree expression::eval_var(utree const& node, source_location const& loc)
 {
     //std::cout << "eval_var: " << node << " " << node.which() << " " << get_node_type(node) << "\n";    
 
-    std::string key = as<std::string>(node);
+    symbol_id id = env.vars.intern(node);
     
-    utree value = env.vars.lookup(key);
+    utree value = env.vars.lookup(id);
     
     if (value == utree::nil_type())
-        throw carto_error("Unknown variable: @" + key, get_location(node));
+        throw carto_error("Unknown variable: @" + env.vars.name(id), loc);
     
-    return (get_node_type(value) == CARTO_EXP_VAR) ? eval_var(value) : value;
+    // the value is a copy, an error in it is reported where it was defined
+    return (get_node_type(value) == CARTO_EXP_VAR) ? eval_var(value, env.vars.location(id)) : value;
 }
 
 utree expression::eval_node(utree const& node)
@@ -45,9 +46,6 @@ utree expression::eval_node(utree const& node)
                 return eval_mult( utree(-1.0), eval_node(node.back()) );
             case CARTO_EXP_FUNCTION:
                 return eval_function(node);
-            case CARTO_EXP_COLOR:
-                BOOST_ASSERT(node.size()==4);
-                return node;
             //case exp_var:
             //    return eval_var(node);
             default:
@@ -58,7 +56,7 @@ utree expression::eval_node(utree const& node)
             }
         }
     } else if (get_node_type(node) == CARTO_EXP_VAR) {
-        return eval_var(node);
+        return eval_var(node, get_location(node));
     }
     //} else {    
     //    std::cout << "Shouldn't be here!\n";
@@ -140,20 +138,4 @@ utree expression::eval_function(utree const& node)
     }
 }
 
-utree expression::fix_color_range(utree const& node) 
-{
-    BOOST_ASSERT(is_color(node) == TRUE);
-    BOOST_ASSERT(node.size() == 4);
-
-    typedef utree::const_iterator iter;
-    
-    utree ut;
-    ut.tag(node.tag()); 
-    for(iter it = node.begin(); it != node.end(); it++)
-        ut.push_back( fmod(as<double>(*it), 256) );
-    
-    return ut;
-}
-
-
 }
@@ -0,0 +1,60 @@
+#include <generate/filter_chain.hpp>
+#include <generate/generate_filter.hpp>
+#include <generate/normalize_filter.hpp>
+
+#include <mapnik/value.hpp>
+
+namespace carto {
+
+filter_chain::filter_chain()
+  : head_() { }
+
+filter_chain::filter_chain(filter_chain const& parent, mapnik::expr_node const& conditions)
+  : head_()
+{
+    boost::shared_ptr<link> l(new link);
+
+    l->parent     = parent.head_;
+    l->conditions = normalize_filter(conditions);
+    l->depth      = parent.head_ ? parent.head_->depth + 1 : 1;
+
+    filter_terms(l->conditions, l->terms);
+
+    head_ = l;
+}
+
+bool filter_chain::empty() const
+{
+    return !head_;
+}
+
+void filter_chain::terms(std::vector<std::string>& out) const
+{
+    if (!head_)
+        return;
+
+    std::vector<link const*> levels(head_->depth);
+    std::size_t i = levels.size();
+
+    for (link const* l = head_.get(); l; l = l->parent.get())
+        levels[--i] = l;
+
+    for (i = 0; i != levels.size(); ++i)
+        out.insert(out.end(), levels[i]->terms.begin(), levels[i]->terms.end());
+}
+
+mapnik::expr_node filter_chain::build() const
+{
+    if (!head_)
+        return mapnik::expr_node(mapnik::value(true));
+
+    // innermost level last, the way the filters used to be and-ed
+    mapnik::expr_node filter = head_->conditions;
+
+    for (link const* l = head_->parent.get(); l; l = l->parent.get())
+        prepend_operand<mapnik::tags::logical_and>(filter, l->conditions);
+
+    return normalize_filter(filter);
+}
+
+}
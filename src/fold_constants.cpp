@@ -0,0 +1,177 @@
+#include <fold_constants.hpp>
+
+#include <utility>
+#include <vector>
+
+#include <expression_eval.hpp>
+#include <parse/node_types.hpp>
+#include <utility/environment.hpp>
+#include <utility/carto_error.hpp>
+
+namespace carto {
+
+namespace {
+
+struct constant_folder {
+    typedef utree::iterator iter;
+    typedef utree::const_iterator const_iter;
+
+    annotations_type const& annotations;
+
+    // top level variables bound to literals so far
+    style_env constants;
+
+    // number of definitions of every variable anywhere in the stylesheet
+    std::vector<unsigned> definitions;
+
+    std::vector< std::pair<utree*, utree> > folds;
+
+    constant_folder(annotations_type const& annotations_)
+      : annotations(annotations_), constants(), definitions(), folds() { }
+
+    int get_node_type(utree const& ut)
+    {
+        return annotations.type(ut);
+    }
+
+    symbol_id intern(utree const& name)
+    {
+        symbol_id id = constants.vars.intern(name);
+
+        if (id >= definitions.size())
+            definitions.resize(id + 1, 0);
+
+        return id;
+    }
+
+    void count_definitions(utree const& elements)
+    {
+        const_iter it  = elements.begin(),
+                   end = elements.end();
+
+        for (; it != end; ++it) {
+            switch (get_node_type(*it)) {
+                case CARTO_VARIABLE:
+                    ++definitions[intern((*it).front())];
+                    break;
+                case CARTO_MAP_STYLE:
+                    count_definitions(*it);
+                    break;
+                case CARTO_STYLE:
+                    count_definitions((*it).back());
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    // mirrors the statement order of mss_parser, so a variable is only
+    // visible to the expressions that follow its definition
+    void fold_elements(utree& elements, bool top)
+    {
+        iter it  = elements.begin(),
+             end = elements.end();
+
+        for (; it != end; ++it) {
+            switch (get_node_type(*it)) {
+                case CARTO_VARIABLE:
+                    fold_value((*it).back());
+                    if (top) bind(*it);
+                    break;
+                case CARTO_ATTRIBUTE:
+                    fold_value((*it).back());
+                    break;
+                case CARTO_MAP_STYLE:
+                    fold_elements(*it, false);
+                    break;
+                case CARTO_STYLE:
+                    fold_elements((*it).back(), false);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    bool fold_value(utree& value)
+    {
+        if (get_node_type(value) != CARTO_EXPRESSION)
+            return false;
+
+        try {
+            expression exp(value.front().front(), annotations, constants);
+            folds.push_back(std::make_pair(&value, exp.eval()));
+        } catch (std::exception&) {
+            return false;
+        }
+
+        return true;
+    }
+
+    // records the value of a top level variable if it can never be
+    // shadowed or redefined, i.e. this is its only definition
+    void bind(utree const& node)
+    {
+        symbol_id id = intern(node.front());
+
+        if (definitions[id] != 1)
+            return;
+
+        utree const& value = node.back();
+        utree literal;
+
+        if (!folds.empty() && folds.back().first == &value) {
+            literal = folds.back().second;
+        } else if (get_node_type(value) == CARTO_VARIABLE) {
+            literal = constants.vars.lookup(constants.vars.intern(value));
+            if (literal == utree::nil_type())
+                return;
+        } else if (get_node_type(value) == CARTO_EXPRESSION) {
+            return;
+        } else {
+            literal = (value.size() == 1) ? value.front() : value;
+        }
+
+        constants.vars.define(id, literal);
+    }
+};
+
+}
+
+std::size_t fold_constants(parse_tree& tree)
+{
+    utree& root = tree.ast();
+
+    constant_folder folder(tree.annotations());
+    folder.count_definitions(root);
+    folder.fold_elements(root, true);
+
+    if (folder.folds.empty())
+        return 0;
+
+    // the folded nodes keep their addresses and locations but lose their
+    // subtrees, and become plain untyped values like any other literal
+    std::vector<utree const*> roots;
+
+    for (std::size_t i = 0; i != folder.folds.size(); ++i) {
+        utree const& folded = *folder.folds[i].first;
+
+        for (utree::const_iterator it = folded.begin(); it != folded.end(); ++it)
+            roots.push_back(&*it);
+    }
+
+    tree.annotations().erase(roots);
+
+    for (std::size_t i = 0; i != folder.folds.size(); ++i) {
+        utree value;
+        value.push_back(folder.folds[i].second);
+
+        *folder.folds[i].first = value;
+        tree.annotations().set_type(*folder.folds[i].first, CARTO_UNDEFINED);
+    }
+
+    return folder.folds.size();
+}
+
+}
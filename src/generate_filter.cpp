@@ -1,6 +1,8 @@
 #include <generate/generate_filter.hpp>
 
-#include <iosfwd>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <sstream>
 
 #include <parse/parse_tree.hpp>
@@ -8,47 +10,96 @@
 
 #include <utility/environment.hpp>
 #include <utility/utree.hpp>
+#include <utility/round.hpp>
 #include <utility/carto_error.hpp>
+#include <utility/profile.hpp>
 
+#include <mapnik/value.hpp>
+#include <mapnik/attribute.hpp>
+#include <mapnik/expression_string.hpp>
 
 namespace carto {
 
-static 
-double const zoom_ranges[] = { 1000000000, 500000000, 200000000, 100000000,
-                                 50000000,  25000000,  12500000,   6500000,
-                                  3000000,   1500000,    750000,    400000,
-                                   200000,    100000,     50000,     25000,
-                                    12500,      5000,      2500,      1500,
-                                      750,       500,       250,       100};
+namespace {
+
+// string literals keep their quotes in the parse tree
+std::string unquote(std::string const& str)
+{
+    if (str.size() >= 2 && str[0] == '\'' && str[str.size()-1] == '\'')
+        return str.substr(1, str.size()-2);
+    
+    return str;
+}
+
+UnicodeString to_unicode(std::string const& str)
+{
+    return UnicodeString::fromUTF8(str);
+}
+
+// plain value, ignores annotations since values coming out of the 
+// environment were annotated by the stylesheet grammar, not this one
+mapnik::expr_node literal(utree const& ut)
+{
+    using spirit::utree_type;
+    
+    switch (ut.which()) {
+        case utree_type::nil_type:
+            return mapnik::value();
+        case utree_type::bool_type:
+            return mapnik::value(ut.get<bool>());
+        case utree_type::int_type:
+            return mapnik::value(ut.get<int>());
+        case utree_type::double_type:
+        {
+            // whole numbers stay integers, as they did when filters were 
+            // printed and reparsed
+            double d = ut.get<double>();
+            
+            if (d == std::floor(d) && std::fabs(d) <= (std::numeric_limits<int>::max)())
+                return mapnik::value(int(d));
+            
+            return mapnik::value(d);
+        }
+        case utree_type::list_type:
+            if (ut.size() == 1)
+                return literal(ut.front());
+            // fall through
+        default:
+            return mapnik::value(to_unicode(unquote(as<std::string>(ut))));
+    }
+}
+
+}
 
 filter_printer::filter_printer(utree const& tree_, annotations_type const& annotations_, 
-                               style_env const& env_, mapnik::rule& rule_)
+                               style_env const& env_, rule_builder& rule_,
+                               zoom_table const& zooms_)
   : tree(tree_),
     annotations(annotations_),
     env(env_),
-    rule(rule_)
+    rule(rule_),
+    zooms(zooms_)
 {}
     
-std::string filter_printer::print()
+filter_printer::result_type filter_printer::generate()
 {
+    profiler::count(profiler::filters_generated);
+    
     return (*this)(tree);
 }
     
 utree filter_printer::parse_var(utree const& ut)
 {
     BOOST_ASSERT(ut.size()==1);
-    BOOST_ASSERT(    annotations[ut.tag()].second == FILTER_VAR 
-                  || annotations[ut.tag()].second == FILTER_VAR_ATTR);
+    BOOST_ASSERT(    annotations.type(ut) == FILTER_VAR 
+                  || annotations.type(ut) == FILTER_VAR_ATTR);
     
-    std::string key = as<std::string>(ut);
+    symbol_id id = env.vars.intern(ut);
     
-    //for (; it != end; ++it)
-    //    key += detail::as<std::string>(*it);
-        
-    utree value = env.vars.lookup(key);
+    utree value = env.vars.lookup(id);
     
     if (value == utree::nil_type())
-        throw carto_error("Unknown variable: @"+key, get_location(ut));
+        throw carto_error("Unknown variable: @"+env.vars.name(id), annotations.location(ut));
     
     return value;
 }
@@ -56,217 +107,225 @@ utree filter_printer::parse_var(utree const& ut)
 double filter_printer::parse_zoom_value(utree const& ut)
 {
     if (ut.tag() != 0){
-        int node_type = annotations[ut.tag()].second;
+        int node_type = annotations.type(ut);
     
-        if (node_type == FILTER_VAR_ATTR) {
+        if (node_type == FILTER_VAR || node_type == FILTER_VAR_ATTR) {
             return round( as<double>(parse_var(ut)) );
         } else {
             std::stringstream out;
             out << "Invalid node type: " << node_type;
-            throw carto_error(out.str(), get_location(ut));
+            throw carto_error(out.str(), annotations.location(ut));
         }
         
     } else {
         return round( as<double>(ut) );
     }
 }
+
+std::string filter_printer::attribute_name(utree const& ut)
+{
+    if (ut.tag() == 0)
+        return "";
+    
+    switch (annotations.type(ut)) {
+        case FILTER_ATTRIBUTE:
+            return as<std::string>(ut.front());
+        case FILTER_VAR_ATTR:
+            return as<std::string>(parse_var(ut));
+        default:
+            return "";
+    }
+}
+
+mapnik::expr_node filter_printer::value(utree const& ut)
+{
+    if (ut.tag() != 0) {
+        switch (annotations.type(ut)) {
+            case FILTER_ATTRIBUTE:
+            case FILTER_VAR_ATTR:
+                return mapnik::attribute(attribute_name(ut));
+            case FILTER_VAR:
+                return literal(parse_var(ut));
+            default:
+                break;
+        }
+    }
+    
+    return literal(ut);
+}
+
+template<class Tag>
+filter_printer::result_type filter_printer::comparison(utree const& lhs, utree const& rhs)
+{
+    return mapnik::expr_node(mapnik::binary_node<Tag>(value(lhs), value(rhs)));
+}
     
-std::string filter_printer::operator() (utree const& ut)
+filter_printer::result_type filter_printer::operator() (utree const& ut)
 {
     using spirit::utree_type;
     
-    std::string out;
-    
     if (ut.tag() == 0) {
-        if (ut.which() == utree_type::list_type) {
-            utree::const_iterator it = ut.begin(), end = ut.end();
-            for (; it != end; ++it) 
-                out += (*this)(*it);
-        } else {
-            out += as<std::string>(ut);
+        if (ut.which() != utree_type::list_type)
+            return result_type(literal(ut));
+        
+        result_type out;
+        
+        utree::const_iterator it = ut.begin(), end = ut.end();
+        for (; it != end; ++it) {
+            result_type node = (*this)(*it);
+            
+            if (!node)
+                continue;
+            
+            if (out)
+                append_operand<mapnik::tags::logical_and>(*out, *node);
+            else
+                out = node;
         }
         
         return out;
     }
     
-    int const node_type = annotations[ut.tag()].second;
-    
-    typedef utree::const_iterator iter;
-    iter it = ut.begin(),
-        end = ut.end();
+    int const node_type = annotations.type(ut);
     
-    if (node_type == FILTER_VAR || node_type == FILTER_VAR_ATTR) {
+    switch (node_type) {
+        case FILTER_VAR:
+        case FILTER_VAR_ATTR:
+        case FILTER_ATTRIBUTE:
+            return result_type(value(ut));
             
-        utree value = parse_var(ut);
-        
-        if (node_type == FILTER_VAR_ATTR) 
-            out += "[" + (*this)(value) + "]";
-        else
-            out += (*this)(value);
-    } else if (node_type == FILTER_AND) {
-        BOOST_ASSERT(ut.size()==2);
-        
-        std::string a = (*this)(*it); it++;
-        std::string b = (*this)(*it);
-        
-        if (a == "" || b == "")
-            out += (a=="") ? a : b;
-        else
-            out += "(" + a + " and " + b + ")";
-
-    } else if (node_type ==  FILTER_OR) {
-        BOOST_ASSERT(ut.size()==2);
-        
-        std::string a = (*this)(*it); it++;
-        std::string b = (*this)(*it);
-        
-        if (a == "" || b == "")
-            out += (a=="") ? a : b;
-        else
-            out += "(" + a + " or " + b + ")";
+        case FILTER_AND:
+        case FILTER_OR:
+        {
+            BOOST_ASSERT(ut.size()==2);
             
-    } else if (node_type == FILTER_NOT) {
-        BOOST_ASSERT(ut.size()==1);
-        
-        std::string a = (*this)(*it);
-        
-        if (a != "")
-            out += "(not " + a + ")";
-    } else if (node_type == FILTER_MATCH) {
-        BOOST_ASSERT(ut.size()==2);
-        
-        std::string a = (*this)(*it); it++;
-        std::string b = (*this)(*it);
-        
-        out += a + ".match('" + b + "')";
-        
-    } else if (node_type == FILTER_REPLACE) {
-        BOOST_ASSERT(ut.size()==2);
-        
-        std::string a = (*this)(*it); it++;
-        std::string b = (*this)(*it); it++;
-        std::string c = (*this)(*it);
-        
-        out += a + ".replace('" + b + ", " + c + "')";
-        
-    } else if (node_type == FILTER_ATTRIBUTE) {
-        //BOOST_ASSERT(ut.size()==1);
-        out += "[" + (*this)(*it) + "]";
-        
-    } else if (node_type == FILTER_EXPRESSION) {
-        
-    } else if (node_type == FILTER_EQ) {
-        BOOST_ASSERT(ut.size()==2);
-        
-        std::string a = (*this)(*it); it++;
-        
-        if (a == "[zoom]") {
-            int b = round(parse_zoom_value(*it));
-            rule.set_min_scale(zoom_ranges[b+1]);
-            rule.set_max_scale(zoom_ranges[b]);
-        } else {
-            std::string b = (*this)(*it);
-            out += "(" + a + " = " + b + ")";
-        }
-        
-    } else if (node_type == FILTER_NEQ) {
-        BOOST_ASSERT(ut.size()==2);
-
-        std::string a = (*this)(*it); it++;
-
-        if (a == "[zoom]") {
-            throw carto_error("Not equal is not currently supported for zoom levels", get_location(ut));
-        } else {
-            std::string b = (*this)(*it);
-            out += "(" + a + " = " + b + ")";
+            result_type a = (*this)(ut.front()),
+                        b = (*this)(ut.back());
+            
+            if (!a || !b)
+                return a ? a : b;
+            
+            if (node_type == FILTER_AND)
+                return mapnik::expr_node(mapnik::binary_node<mapnik::tags::logical_and>(*a, *b));
+            else
+                return mapnik::expr_node(mapnik::binary_node<mapnik::tags::logical_or>(*a, *b));
         }
-    } else if (node_type ==  FILTER_LE) {
-        BOOST_ASSERT(ut.size()==2);
-        
-        std::string a = (*this)(*it); it++;
         
-        if (a == "[zoom]") {
-            int b = round(parse_zoom_value(*it));
-            rule.set_min_scale(zoom_ranges[b+1]);
-        } else {
-            std::string b = (*this)(*it);
-            out += "(" + a + " = " + b + ")";
+        case FILTER_NOT:
+        {
+            BOOST_ASSERT(ut.size()==1);
+            
+            result_type a = (*this)(ut.front());
+            
+            if (!a)
+                return a;
+            
+            return mapnik::expr_node(mapnik::unary_node<mapnik::tags::logical_not>(*a));
         }
         
-    } else if (node_type ==  FILTER_LT) {
-        BOOST_ASSERT(ut.size()==2);
-        
-        std::string a = (*this)(*it); it++;
-        
-        if (a == "[zoom]") {
-            int b = round(parse_zoom_value(*it));
-            rule.set_min_scale(zoom_ranges[b]);
-        } else {
-            std::string b = (*this)(*it);
-            out += "(" + a + " = " + b + ")";
+        case FILTER_MATCH:
+        {
+            BOOST_ASSERT(ut.size()==2);
+            
+            std::string pattern = unquote(as<std::string>(ut.back()));
+            
+            return mapnik::expr_node(mapnik::regex_match_node(value(ut.front()), to_unicode(pattern)));
         }
         
-    } else if (node_type ==  FILTER_GE) {
-        BOOST_ASSERT(ut.size()==2);
-        
-        std::string a = (*this)(*it); it++;
-        
-        if (a == "[zoom]") {
-            int b = round(parse_zoom_value(*it));
-            rule.set_max_scale(zoom_ranges[b]);
-        } else {
-            std::string b = (*this)(*it);
-            out += "(" + a + " = " + b + ")";
+        case FILTER_REPLACE:
+        {
+            BOOST_ASSERT(ut.size()==2 && ut.back().size()==2);
+            
+            std::string pattern = unquote(as<std::string>(ut.back().front())),
+                        format  = unquote(as<std::string>(ut.back().back()));
+            
+            return mapnik::expr_node(mapnik::regex_replace_node(value(ut.front()), 
+                                                                to_unicode(pattern), to_unicode(format)));
         }
         
-    } else if (node_type == FILTER_GT) {
-        BOOST_ASSERT(ut.size()==2);
-        
-        std::string a = (*this)(*it); it++;
-        
-        if (a == "[zoom]") {
-            int b = round(parse_zoom_value(*it));
-            rule.set_max_scale(zoom_ranges[b+1]);
-        } else {
-            std::string b = (*this)(*it);
-            out += "(" + a + " = " + b + ")";
+        case FILTER_EQ:
+        case FILTER_NEQ:
+        case FILTER_LE:
+        case FILTER_LT:
+        case FILTER_GE:
+        case FILTER_GT:
+        {
+            BOOST_ASSERT(ut.size()==2);
+            
+            utree const& lhs = ut.front();
+            utree const& rhs = ut.back();
+            
+            if (attribute_name(lhs) == "zoom") {
+                if (node_type == FILTER_NEQ)
+                    throw carto_error("Not equal is not currently supported for zoom levels", annotations.location(ut));
+                
+                int b = round(parse_zoom_value(rhs));
+                
+                // zoom levels selected, as far as the table reaches
+                int first = 0, last = zooms.max_zoom();
+                
+                switch (node_type) {
+                    case FILTER_EQ: first = last = b; break;
+                    case FILTER_LE: last  = b;        break;
+                    case FILTER_LT: last  = b - 1;    break;
+                    case FILTER_GE: first = b;        break;
+                    case FILTER_GT: first = b + 1;    break;
+                }
+                
+                double min_scale, max_scale;
+                
+                if (!zooms.scale_range(first, last, min_scale, max_scale)) {
+                    // no zoom level is selected, nor is any scale
+                    rule.set_min_scale(0);
+                    rule.set_max_scale(0);
+                    return result_type();
+                }
+                
+                // narrow the range the rule already has, an open end of
+                // the comparison leaves its side of the range alone
+                if (node_type != FILTER_GE && node_type != FILTER_GT)
+                    rule.set_min_scale(std::max(rule.get_min_scale(), min_scale));
+                if (node_type != FILTER_LE && node_type != FILTER_LT)
+                    rule.set_max_scale(std::min(rule.get_max_scale(), max_scale));
+                
+                return result_type();
+            }
+            
+            switch (node_type) {
+                case FILTER_EQ:  return comparison<mapnik::tags::equal_to>(lhs, rhs);
+                case FILTER_NEQ: return comparison<mapnik::tags::not_equal_to>(lhs, rhs);
+                case FILTER_LE:  return comparison<mapnik::tags::less_equal>(lhs, rhs);
+                case FILTER_LT:  return comparison<mapnik::tags::less>(lhs, rhs);
+                case FILTER_GE:  return comparison<mapnik::tags::greater_equal>(lhs, rhs);
+                default:         return comparison<mapnik::tags::greater>(lhs, rhs);
+            }
         }
         
+        default:
+            return result_type();
     }
-    
-    return out;
-}
-
-std::string filter_printer::operator() (bool b){
-    return b ? "true" : "false";
 }
 
-std::string filter_printer::operator() (spirit::utf8_string_range_type const& str)
+bool is_true_filter(mapnik::expr_node const& node)
 {
-    std::stringstream out;
-    
-    typedef spirit::utf8_string_range_type::const_iterator iterator;
-    iterator it = str.begin(),
-            end = str.end();
+    mapnik::value const* v = boost::get<mapnik::value>(&node);
+    if (!v) 
+        return false;
     
-    for (; it != end; ++it)
-        out << *it;
-        
-    return out.str();
+    bool const* b = boost::get<bool>(&v->base());
+    return b && *b;
 }
 
-std::string filter_printer::operator() (spirit::utf8_symbol_range_type const& str)
+void filter_terms(mapnik::expr_node const& node, std::vector<std::string>& terms)
 {
-    std::stringstream out;
+    typedef mapnik::binary_node<mapnik::tags::logical_and> and_node;
     
-    typedef spirit::utf8_string_range_type::const_iterator iterator;
-    iterator it = str.begin(),
-            end = str.end();
-
-    for (; it != end; ++it)
-        out << *it;
-        
-    return out.str();
+    if (and_node const* n = boost::get<and_node>(&node)) {
+        filter_terms(n->left, terms);
+        filter_terms(n->right, terms);
+    } else if (!is_true_filter(node)) {
+        terms.push_back(mapnik::to_expression_string(node));
+    }
 }
 
 }
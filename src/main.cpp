@@ -5,14 +5,138 @@
 
 #include <mml_parser.hpp>
 #include <mss_parser.hpp>
+#include <cache.hpp>
+#include <utility/version.hpp>
+#include <utility/file_watcher.hpp>
+#include <utility/mapped_file.hpp>
+#include <utility/profile.hpp>
 
 #include <mapnik/save_map.hpp>
 #include <mapnik/datasource_cache.hpp>
 
+#include <boost/optional.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string.hpp>
 
+namespace {
 
+bool write_output(std::string const& output, std::string const& output_file)
+{
+    if (output_file.empty()) {
+        std::cout << output << std::endl;
+        return true;
+    }
+    
+    std::ofstream file;
+    file.open(output_file.c_str());
+    if (!file.is_open()) {
+        std::cout << "Error: could not save xml to: " << output_file << "\n";
+        return false;
+    }
+    file << output;
+    file.close();
+    
+    return true;
+}
+
+bool write_profile(std::string const& profile_file)
+{
+    if (profile_file.empty()) {
+        carto::profiler::write_json(std::cerr);
+        return true;
+    }
+    
+    std::ofstream file(profile_file.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Error: could not save profile to: " << profile_file << "\n";
+        return false;
+    }
+    carto::profiler::write_json(file);
+    
+    return true;
+}
+
+// Keeps the parsed project and the map resident and rewrites the output
+// every time one of its inputs changes. Stylesheet edits only recompile 
+// what they affect, an edit to the mml itself or a failed build starts 
+// over from scratch.
+int watch(std::string const& input_file, std::string const& output_file, carto::zoom_table const& zooms)
+{
+    bool is_mml = boost::algorithm::ends_with(input_file,".mml");
+    
+    carto::file_watcher watcher;
+    boost::scoped_ptr<carto::mml_parser> parser;
+    boost::scoped_ptr<mapnik::Map> map;
+    
+    std::vector<std::string> changed;
+    bool rebuild = true;
+    
+    while (true) {
+        try {
+            if (rebuild) {
+                map.reset(new mapnik::Map(800,600));
+                std::vector<std::string> deps(1, input_file);
+                
+                if (is_mml) {
+                    parser.reset(new carto::mml_parser(input_file, false));
+                    parser->set_zoom_table(zooms);
+                    parser->parse(*map);
+                    deps = parser->get_dependencies();
+                } else {
+                    carto::mss_parser mss(input_file, false);
+                    mss.set_zoom_table(zooms);
+                    carto::style_env env;
+                    mss.parse(*map, env);
+                }
+                
+                watcher.clear();
+                for (std::size_t i = 0; i != deps.size(); ++i)
+                    watcher.add(deps[i]);
+            } else {
+                parser->recompile(*map, changed);
+            }
+            
+            rebuild = false;
+            
+            if (!write_output(mapnik::save_map_to_string(*map,false), output_file))
+                return EXIT_FAILURE;
+            
+            std::cerr << "Watching " << input_file << " for changes\n";
+        } catch (std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            rebuild = true;
+        }
+        
+        // A failed build keeps watching what it has, and adds the 
+        // stylesheets it got to, so fixing the broken one starts the next
+        if (rebuild) {
+            watcher.add(input_file);
+            
+            if (parser) {
+                std::vector<std::string> deps = parser->get_dependencies();
+                for (std::size_t i = 0; i != deps.size(); ++i)
+                    watcher.add(deps[i]);
+            }
+        }
+        
+        changed = watcher.wait();
+        
+        if (!is_mml)
+            rebuild = true;
+        
+        for (std::size_t i = 0; i != changed.size(); ++i) {
+            boost::system::error_code ec;
+            if (boost::filesystem::equivalent(changed[i], input_file, ec))
+                rebuild = true;
+        }
+    }
+    
+    return 0;
+}
+
+}
 
 int main(int argc, char **argv) {
 
@@ -25,14 +149,24 @@ int main(int argc, char **argv) {
     
     std::string mapnik_input_dir = MAPNIKDIR;
     
-    std::string input_file, output_file;
+    std::string input_file, output_file, cache_dir, profile_file;
+    unsigned tile_size = 256, max_zoom = 23;
+    double scale_factor = 1.0;
     
     po::options_description desc("carto");
     desc.add_options()
         ("help,h", "produce this usage message")
         ("version,V","print version string")
         ("in", po::value<std::string>(&input_file),  "input carto file (mml or mss)")
-        ("out", po::value<std::string>(&output_file), "output xml file");
+        ("out", po::value<std::string>(&output_file), "output xml file")
+        ("cache-dir", po::value<std::string>(&cache_dir), "reuse compiled output and parse trees stored in this directory")
+        ("watch,w", "keep running and rewrite the output whenever an input file changes")
+        ("tile-size", po::value<unsigned>(&tile_size), "size in pixels of the tiles zoom levels are computed for (default 256)")
+        ("scale-factor", po::value<double>(&scale_factor), "scale factor the map is rendered with (default 1)")
+        ("max-zoom", po::value<unsigned>(&max_zoom), "highest zoom level filters can select, up to 30 (default 23)")
+        ("verbose,v", "report what the compiler did on stderr")
+        ("profile", po::value<std::string>(&profile_file)->implicit_value(""), 
+                    "write the time spent in each phase and input file and what the compiler did as json, to stderr or --profile=file");
     
     std::string usage("\nusage: carto map.[mml|mss] [map.xml]");
     
@@ -45,7 +179,7 @@ int main(int argc, char **argv) {
     
     if (vm.count("version"))
     {
-        std::cout << "version 0.0.0" << std::endl;
+        std::cout << "version " << CARTO_PARSER_VERSION << std::endl;
         return 1;
     }
 
@@ -65,37 +199,96 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-
+    // filters keep the scales carto has always used unless the tiles or
+    // the rendering differ, --max-zoom alone only extends or cuts the table
+    carto::zoom_table zooms;
     
     try {
-        mapnik::Map m(800,600);
-        
-        if (boost::algorithm::ends_with(input_file,".mml"))
-        {
-            carto::mml_parser parser(input_file, false);
-            parser.parse(m);
+        if (vm.count("tile-size") || vm.count("scale-factor"))
+            zooms = carto::zoom_table(tile_size, scale_factor, max_zoom);
+        else if (vm.count("max-zoom"))
+            zooms = carto::zoom_table(max_zoom);
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+    
+    if (vm.count("watch"))
+    {
+        try {
+            return watch(input_file, output_file, zooms);
+        } catch (std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return EXIT_FAILURE;
         }
-        else if (boost::algorithm::ends_with(input_file,".mss")) 
-        {
-            carto::mss_parser parser(input_file, false);
-            carto::style_env env;
-            parser.parse(m, env);
+    }
+    
+    // the profile covers a single compile, watch mode does not report one
+    if (vm.count("profile"))
+        carto::profiler::enable();
+    
+    int status = 0;
+    
+    try {
+        carto::profiler::timer total("total", input_file);
+        
+        boost::scoped_ptr<carto::compile_cache> cache;
+        boost::optional<std::string> cached;
+        
+        if (vm.count("cache-dir")) {
+            carto::profiler::timer timer("cache", input_file);
+            cache.reset(new carto::compile_cache(cache_dir));
+            cached = cache->load_map(input_file, zooms.key());
         }
         
-        std::string output = mapnik::save_map_to_string(m,false);
+        std::string output;
         
-        if (!vm.count("out")) {
-            std::cout << output << std::endl;
+        if (cached) {
+            output = *cached;
         } else {
-            std::ofstream file;
-            file.open(output_file.c_str());
-            if (!file.is_open()) {
-                std::cout << "Error: could not save xml to: " << output_file << "\n";
-                return EXIT_FAILURE;
+            mapnik::Map m(800,600);
+            std::vector<std::string> deps(1, input_file), hashes;
+            std::size_t folded = 0;
+            
+            if (boost::algorithm::ends_with(input_file,".mml"))
+            {
+                carto::mml_parser parser(input_file, false);
+                parser.set_cache(cache.get());
+                parser.set_zoom_table(zooms);
+                parser.parse(m);
+                deps = parser.get_dependencies();
+                hashes = parser.get_dependency_hashes();
+                folded = parser.folded_constants();
+            }
+            else if (boost::algorithm::ends_with(input_file,".mss")) 
+            {
+                // hashed as read, it may change on disk while it compiles
+                carto::mapped_file file(input_file);
+                std::string source(file.begin(), file.end());
+                
+                hashes.push_back(carto::compile_cache::hash(source));
+                
+                carto::mss_parser parser(source, input_file, false);
+                parser.set_zoom_table(zooms);
+                carto::style_env env;
+                parser.parse(m, env);
+                folded = parser.folded_constants();
             }
-            file << output;
-            file.close();
+            
+            if (vm.count("verbose"))
+                std::cerr << "Folded " << folded << " constant expressions\n";
+            
+            {
+                carto::profiler::timer timer("xml", input_file);
+                output = mapnik::save_map_to_string(m,false);
+            }
+            
+            if (cache)
+                cache->store_map(input_file, deps, hashes, output, zooms.key());
         }
+        
+        if (!write_output(output, output_file))
+            status = EXIT_FAILURE;
             
             
        
@@ -105,5 +298,8 @@ int main(int argc, char **argv) {
         std::cerr << "Error: Unknown error\n";
     }
     
-    return 0;
+    if (vm.count("profile") && !write_profile(profile_file))
+        status = EXIT_FAILURE;
+    
+    return status;
 }
@@ -9,6 +9,7 @@
 #include <mss_parser.hpp>
 
 #include <iosfwd>
+#include <set>
 #include <sstream>
 
 #include <mapnik/map.hpp>
@@ -17,15 +18,25 @@
 #include <mapnik/datasource.hpp>
 #include <mapnik/datasource_cache.hpp>
 
+#include <boost/make_shared.hpp>
+#include <boost/exception_ptr.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <mss_parser.hpp>
+#include <fold_constants.hpp>
+#include <selector_index.hpp>
 #include <parse/parse_tree.hpp>
 #include <parse/json_grammar.hpp>
 
 #include <utility/utree.hpp>
 #include <utility/carto_error.hpp>
+#include <utility/line_index.hpp>
+#include <utility/mapped_file.hpp>
+#include <utility/parallel.hpp>
+#include <utility/profile.hpp>
+
+#include <exception.hpp>
 
 namespace carto {
 
@@ -34,35 +45,38 @@ namespace al = boost::algorithm;
 mml_parser::mml_parser(parse_tree const& pt, std::string const& path_, bool strict_)
   : tree(pt),
     strict(strict_),
-    path(path_) { }
+    path(path_),
+    hash(),
+    cache(0),
+    zooms() { }
   
 mml_parser::mml_parser(std::string const& in, std::string const& path_, bool strict_)
   : strict(strict_),
-    path(path_) 
+    path(path_),
+    hash(compile_cache::hash(in)),
+    cache(0),
+    zooms()
 { 
-    typedef position_iterator<std::string::const_iterator> it_type;
-    tree = build_parse_tree< json_parser<it_type> >(in, path);    
+    typedef position_iterator<char const*> it_type;
+    
+    profiler::timer timer("parse", path);
+    tree = build_parse_tree< json_parser<it_type> >(boost::make_iterator_range(in.data(), in.data()+in.size()), path);    
 }
 
 mml_parser::mml_parser(std::string const& filename, bool strict_)
   : strict(strict_),
-    path(filename) 
+    path(filename),
+    hash(),
+    cache(0),
+    zooms()
 {
+    mapped_file file(filename);
+    hash = compile_cache::hash(file.begin(), file.end());
 
-    std::ifstream file(filename.c_str(), std::ios_base::in);
-
-    if (!file)
-        throw carto_error(std::string("Cannot open input file: ")+filename);
-        
+    typedef position_iterator<char const*> it_type;
     
-    std::string in;
-    file.unsetf(std::ios::skipws);
-    copy(std::istream_iterator<char>(file),
-         std::istream_iterator<char>(),
-         std::back_inserter(in));
-
-    typedef position_iterator<std::string::const_iterator> it_type;
-    tree = build_parse_tree< json_parser<it_type> >(in, path);    
+    profiler::timer timer("parse", path);
+    tree = build_parse_tree< json_parser<it_type> >(file.range(), path);    
 }
 
 parse_tree mml_parser::get_parse_tree()
@@ -75,14 +89,58 @@ std::string mml_parser::get_path()
     return path;
 }
 
+std::vector<std::string> mml_parser::get_dependencies()
+{
+    std::vector<std::string> deps(1, path);
+    
+    for (std::size_t i = 0; i != stylesheets.size(); ++i) {
+        if (stylesheets[i].from_file)
+            deps.push_back(stylesheets[i].path);
+    }
+    
+    return deps;
+}
+
+std::vector<std::string> mml_parser::get_dependency_hashes()
+{
+    std::vector<std::string> hashes(1, hash);
+    
+    for (std::size_t i = 0; i != stylesheets.size(); ++i) {
+        if (stylesheets[i].from_file)
+            hashes.push_back(stylesheets[i].hash);
+    }
+    
+    return hashes;
+}
+
+std::size_t mml_parser::folded_constants()
+{
+    std::size_t n = 0;
+    
+    for (std::size_t i = 0; i != stylesheets.size(); ++i)
+        n += stylesheets[i].folded;
+    
+    return n;
+}
+
+void mml_parser::set_cache(compile_cache const* cache_)
+{
+    cache = cache_;
+}
+
+void mml_parser::set_zoom_table(zoom_table const& zooms_)
+{
+    zooms = zooms_;
+}
+
 node_type mml_parser::get_node_type(utree const& ut)
 {   
-    return (node_type) tree.annotations(ut.tag()).second;
+    return (node_type) tree.annotations().type(ut);
 }
 
 source_location mml_parser::get_location(utree const& ut)
 {    
-    return tree.annotations()[ut.tag()].first;
+    return tree.annotations().location(ut);
 }
 
 void mml_parser::key_error(std::string const& key, utree const& node)
@@ -153,58 +211,138 @@ void mml_parser::parse_map(mapnik::Map& map)
         }        
     }
     
-    typedef std::pair< std::string, std::vector<std::string> > style_pair;
-    std::vector<style_pair> style_selectors;
+    attach_styles(map);
+}
+
+void mml_parser::attach_styles(mapnik::Map& map)
+{
+    profiler::timer timer("attach", path);
+    
+    for (unsigned i = 0; i != map.layer_count(); ++i)
+        map.getLayer(i).styles().clear();
+    
+    selector_index index;
     
     mapnik::Map::const_style_iterator s_it  =  map.begin_styles(),
                                       s_end =  map.end_styles();
     
-    for(; s_it!=s_end; ++s_it) {
-        std::string name = (*s_it).first;
+    for(; s_it!=s_end; ++s_it)
+        index.insert((*s_it).first);
+    
+    std::vector<std::string> matched;
+    
+    for(size_t i=0; i != layer_selectors.size(); ++i) {
+        matched.clear();
+        index.match(layer_selectors[i], matched);
+        
+        for (size_t j=0; j != matched.size(); ++j)
+            map.getLayer(i).add_style(matched[j]);
+    }
+}
+
+namespace {
+
+struct stylesheet_loader {
+    std::vector<stylesheet>& sheets;
+    std::vector<boost::exception_ptr>& errors;
+    std::vector<bool> const& changed;
+    compile_cache const* cache;
+
+    stylesheet_loader(std::vector<stylesheet>& sheets_, 
+                      std::vector<boost::exception_ptr>& errors_,
+                      std::vector<bool> const& changed_,
+                      compile_cache const* cache_)
+      : sheets(sheets_), 
+        errors(errors_),
+        changed(changed_),
+        cache(cache_) { }
+
+    void fold(stylesheet& sheet) const
+    {
+        profiler::timer timer("fold", sheet.path);
+        sheet.folded = fold_constants(sheet.tree);
+    }
+
+    void load(stylesheet& sheet, boost::iterator_range<char const*> const& in) const
+    {
+        sheet.folded = 0;
+        sheet.hash = compile_cache::hash(in.begin(), in.end());
         
-        // remove attachment from style name
-        size_t loc = name.find("::");
-        if (loc != std::string::npos) {
-            al::erase_tail(name, name.length()-loc);
+        if (!cache) {
+            sheet.tree = parse_mss(in, sheet.path);
+            fold(sheet);
+            return;
         }
+
+        std::string const& key = sheet.hash;
+
+        // cached trees were folded before they were stored
+        boost::optional<parse_tree> pt;
         
-        al::trim_if(name,al::is_any_of(". "));
-        std::vector<std::string> selectors;
-        al::split(selectors, name, al::is_any_of(". "));
+        {
+            profiler::timer timer("cache", sheet.path);
+            pt = cache->load_tree(key);
+        }
         
-        style_selectors.push_back(style_pair((*s_it).first,selectors));
+        if (pt) {
+            sheet.tree = *pt;
+            sheet.tree.annotations().set_lines(boost::make_shared<line_index>(in.begin(), in.end()));
+        } else {
+            sheet.tree = parse_mss(in, sheet.path);
+            fold(sheet);
+            cache->store_tree(key, sheet.tree);
+        }
     }
-    
-    typedef std::vector< std::vector<std::string> >::const_iterator layer_it_type;
-    layer_it_type layer_it  = layer_selectors.begin(),
-                  layer_end = layer_selectors.end();
-    
-    for(size_t i=0; layer_it != layer_end; ++layer_it, ++i) {
-        
-        typedef std::vector<style_pair>::const_iterator style_it_type;
-        style_it_type style_it  = style_selectors.begin(),
-                      style_end = style_selectors.end();
-        
-        for(; style_it != style_end; ++style_it) {
-            typedef std::vector<std::string>::const_iterator selector_it_type;
+
+    void operator() (std::size_t i) const
+    {
+        if (!changed[i])
+            return;
         
-            selector_it_type lselect_it  = (*layer_it).begin(),
-                             lselect_end = (*layer_it).end(),
-                             sselect_it  = (*style_it).second.begin(),
-                             sselect_end = (*style_it).second.end();
-            
-            for(; lselect_it != lselect_end; ++lselect_it) {
-                while(sselect_it != sselect_end && *lselect_it != *sselect_it) {
-                    ++sselect_it;
-                }
-                
-                if (sselect_it == sselect_end) break;
+        stylesheet& sheet = sheets[i];
+
+        try {
+            if (sheet.from_file) {
+                mapped_file file(sheet.path);
+                load(sheet, file.range());
+            } else {
+                load(sheet, boost::make_iterator_range(sheet.source.data(), 
+                                                       sheet.source.data() + sheet.source.size()));
             }
-            
-            if (lselect_it == lselect_end && sselect_it != sselect_end)
-                map.getLayer(i).add_style((*style_it).first);
+        } catch (expected_component& e) {
+            // our own exceptions are not thrown through boost, so they are
+            // copied as what they are rather than captured
+            errors[i] = boost::copy_exception(e);
+        } catch (carto::exception& e) {
+            errors[i] = boost::copy_exception(e);
+        } catch (carto_error& e) {
+            errors[i] = boost::copy_exception(e);
+        } catch (...) {
+            errors[i] = boost::current_exception();
         }
     }
+};
+
+bool intersects(std::set<std::string> const& a, std::set<std::string> const& b)
+{
+    typedef std::set<std::string>::const_iterator iter;
+    iter a_it  = a.begin(),
+         a_end = a.end(),
+         b_it  = b.begin(),
+         b_end = b.end();
+    
+    while (a_it != a_end && b_it != b_end) {
+        if (*a_it < *b_it)
+            ++a_it;
+        else if (*b_it < *a_it)
+            ++b_it;
+        else
+            return true;
+    }
+    
+    return false;
+}
+
 }
 
 void mml_parser::parse_stylesheet(mapnik::Map& map, utree const& node)
@@ -218,25 +356,157 @@ void mml_parser::parse_stylesheet(mapnik::Map& map, utree const& node)
     
     fs::path parent_dir = fs::path(path).parent_path();
     
-    style_env env;
+    stylesheets.clear();
     for (; it != end; ++it) {
+        stylesheet sheet;
+
         std::string data( as<std::string>(*it) );
         fs::path abs_path( data ),
             rel_path = parent_dir / abs_path;
         
         if (fs::exists(abs_path)) {
-            mss_parser parser(abs_path.string(), strict);
-            parser.parse(map, env);
+            sheet.path = abs_path.string();
+            sheet.from_file = true;
         } else if (fs::exists(rel_path)) {
-            mss_parser parser(rel_path.string(), strict);
-            parser.parse(map, env);
+            sheet.path = rel_path.string();
+            sheet.from_file = true;
         } else {
-            mss_parser parser(data, path, strict);
+            sheet.path = path;
+            sheet.source = data;
+            sheet.from_file = false;
+        }
+
+        stylesheets.push_back(sheet);
+    }
+    
+    // Parsing is independent per stylesheet so it runs on the pool, 
+    // evaluation shares the environment and the map so it stays in order
+    load_stylesheets();
+    rebuild(map, std::vector<bool>(stylesheets.size(), true));
+}
+
+void mml_parser::load_stylesheets()
+{
+    load_stylesheets(std::vector<bool>(stylesheets.size(), true));
+}
+
+void mml_parser::load_stylesheets(std::vector<bool> const& changed)
+{
+    std::vector<boost::exception_ptr> errors(stylesheets.size());
+
+    parallel_for(stylesheets.size(), stylesheet_loader(stylesheets, errors, changed, cache));
+
+    // the error of the first stylesheet in the project wins
+    for (std::size_t i = 0; i != errors.size(); ++i) {
+        if (errors[i])
+            boost::rethrow_exception(errors[i]);
+    }
+}
+
+// Brings a map built by parse() up to date after some of its stylesheet 
+// files changed on disk. Only the changed files are reparsed; a stylesheet
+// is re-evaluated if it changed, uses a variable defined by a re-evaluated
+// stylesheet, or adds rules to a style one of them touches. Everything else
+// only has its top level definitions replayed. Changes to the mml file 
+// itself need a full parse.
+void mml_parser::recompile(mapnik::Map& map, std::vector<std::string> const& changed)
+{
+    namespace fs = boost::filesystem;
+    
+    std::vector<bool> dirty(stylesheets.size(), false);
+    bool any = false;
+    
+    for (std::size_t i = 0; i != stylesheets.size(); ++i) {
+        if (!stylesheets[i].from_file)
+            continue;
+        
+        for (std::size_t j = 0; j != changed.size(); ++j) {
+            boost::system::error_code ec;
+            
+            if (fs::equivalent(fs::path(changed[j]), fs::path(stylesheets[i].path), ec)) {
+                dirty[i] = any = true;
+                break;
+            }
+        }
+    }
+    
+    if (!any)
+        return;
+    
+    load_stylesheets(dirty);
+    
+    // the old dependencies decide what the edit can have invalidated, the 
+    // new ones what it invalidates now (e.g. a newly defined variable)
+    close_dependencies(dirty);
+    rebuild(map, dirty);
+    
+    while (close_dependencies(dirty))
+        rebuild(map, dirty);
+    
+    attach_styles(map);
+}
+
+void mml_parser::rebuild(mapnik::Map& map, std::vector<bool> const& dirty)
+{
+    typedef std::set<std::string>::const_iterator iter;
+    
+    for (std::size_t i = 0; i != stylesheets.size(); ++i) {
+        if (!dirty[i])
+            continue;
+        
+        iter it  = stylesheets[i].deps.styles.begin(),
+             end = stylesheets[i].deps.styles.end();
+        
+        for (; it != end; ++it)
+            map.remove_style(*it);
+    }
+    
+    style_env env;
+    for (std::size_t i = 0; i != stylesheets.size(); ++i) {
+        mss_parser parser(stylesheets[i].tree, stylesheets[i].path, strict);
+        parser.set_zoom_table(zooms);
+        
+        if (dirty[i]) {
+            stylesheets[i].deps.clear();
+            parser.set_dependencies(&stylesheets[i].deps);
             parser.parse(map, env);
+        } else {
+            parser.parse_definitions(map, env);
         }
     }
 }
 
+bool mml_parser::close_dependencies(std::vector<bool>& dirty)
+{
+    bool grown = false;
+    bool changed = true;
+    
+    while (changed) {
+        changed = false;
+        
+        std::set<std::string> defines, styles;
+        for (std::size_t i = 0; i != stylesheets.size(); ++i) {
+            if (!dirty[i])
+                continue;
+            
+            defines.insert(stylesheets[i].deps.defines.begin(), stylesheets[i].deps.defines.end());
+            styles.insert(stylesheets[i].deps.styles.begin(), stylesheets[i].deps.styles.end());
+        }
+        
+        for (std::size_t i = 0; i != stylesheets.size(); ++i) {
+            if (dirty[i])
+                continue;
+            
+            if (intersects(stylesheets[i].deps.uses, defines) || 
+                intersects(stylesheets[i].deps.styles, styles)) {
+                dirty[i] = changed = grown = true;
+            }
+        }
+    }
+    
+    return grown;
+}
+
 void mml_parser::parse_layer(mapnik::Map& map, utree const& node)
 {
     mapnik::layer lyr("");
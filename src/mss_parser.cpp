@@ -9,6 +9,8 @@
 
 #include <boost/functional/hash.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/optional.hpp>
 
 #include <parse/carto_grammar.hpp>
 #include <parse/parse_tree.hpp>
@@ -27,12 +29,16 @@
 #include <mapnik/parse_transform.hpp>
 
 #include <expression_eval.hpp>
+#include <fold_constants.hpp>
+#include <property_table.hpp>
 #include <generate/generate_filter.hpp>
 #include <utility/utree.hpp>
 #include <utility/environment.hpp>
 #include <utility/version.hpp>
 #include <utility/round.hpp>
 #include <utility/carto_error.hpp>
+#include <utility/mapped_file.hpp>
+#include <utility/profile.hpp>
 
 namespace carto {
 
@@ -40,37 +46,64 @@ mss_parser::mss_parser(parse_tree const& pt, std::string const& path_, bool stri
   : tree(pt),
     strict(strict_),
     path(path_),
+    deps(0),
+    folded(0),
+    pending(),
+    definition_count(0),
+    quiet(false),
+    zooms(),
     expr_grammar(mapnik::transcoder("utf8"))
 {}
   
 mss_parser::mss_parser(std::string const& in, std::string const& path_, bool strict_)
-  : strict(strict_),
+  : tree(parse_mss_string(in, path_)),
+    strict(strict_),
     path(path_),
+    deps(0),
+    folded(0),
+    pending(),
+    definition_count(0),
+    quiet(false),
+    zooms(),
     expr_grammar(mapnik::transcoder("utf8"))
-{ 
-    typedef position_iterator<std::string::const_iterator> iter;
-    tree = build_parse_tree< carto_parser<iter> >(in, path);    
+{
+    profiler::timer timer("fold", path);
+    folded = fold_constants(tree);
 }
 
 mss_parser::mss_parser(std::string const& filename, bool strict_)
-  : strict(strict_),
+  : tree(parse_mss(filename)),
+    strict(strict_),
     path(filename),
+    deps(0),
+    folded(0),
+    pending(),
+    definition_count(0),
+    quiet(false),
+    zooms(),
     expr_grammar(mapnik::transcoder("utf8"))
-{ 
+{
+    profiler::timer timer("fold", path);
+    folded = fold_constants(tree);
+}
 
-    std::ifstream file(filename.c_str(), std::ios_base::in);
+parse_tree parse_mss(std::string const& filename)
+{
+    mapped_file file(filename);
+    return parse_mss(file.range(), filename);
+}
 
-    if (!file)
-        throw carto_error(std::string("Cannot open input file: ")+filename);
+parse_tree parse_mss(boost::iterator_range<char const*> const& in, std::string const& path)
+{
+    typedef position_iterator<char const*> iter;
     
-    std::string in;
-    file.unsetf(std::ios::skipws);
-    copy(std::istream_iterator<char>(file),
-         std::istream_iterator<char>(),
-         std::back_inserter(in));
+    profiler::timer timer("parse", path);
+    return build_parse_tree< carto_parser<iter> >(in, path);
+}
 
-    typedef position_iterator<std::string::const_iterator> iter;
-    tree = build_parse_tree< carto_parser<iter> >(in, path);    
+parse_tree parse_mss_string(std::string const& in, std::string const& path)
+{
+    return parse_mss(boost::make_iterator_range(in.data(), in.data()+in.size()), path);
 }
 
 parse_tree mss_parser::get_parse_tree()
@@ -83,14 +116,29 @@ std::string mss_parser::get_path()
     return path;
 }
 
+std::size_t mss_parser::folded_constants()
+{
+    return folded;
+}
+
+void mss_parser::set_dependencies(dependency_set* deps_)
+{
+    deps = deps_;
+}
+
+void mss_parser::set_zoom_table(zoom_table const& zooms_)
+{
+    zooms = zooms_;
+}
+
 int mss_parser::get_node_type(utree const& ut)
 {   
-    return( tree.annotations(ut.tag()).second );
+    return( tree.annotations().type(ut) );
 }
 
 source_location mss_parser::get_location(utree const& ut)
 {    
-    return tree.annotations()[ut.tag()].first;
+    return tree.annotations().location(ut);
 }
 
 std::string const& mss_parser::get_fontset_name(std::size_t hash) 
@@ -107,7 +155,7 @@ std::string const& mss_parser::get_fontset_name(std::size_t hash)
     }
 }
 
-mapnik::transform_type mss_parser::create_transform(std::string const& str, utree const& node)
+mapnik::transform_type mss_parser::create_transform(std::string const& str, source_location const& loc)
 {
     mapnik::transform_type trans( mapnik::parse_transform(str) );
 
@@ -116,27 +164,126 @@ mapnik::transform_type mss_parser::create_transform(std::string const& str, utre
         std::stringstream str;
         str << "Could not parse transform from '" << str << "', expected transform attribute";
         
-        carto_error err(str.str(), get_location(node));
-        if (strict) throw err;   
-        else        warn(err);
+        carto_error err(str.str(), loc);
+        if (strict)      throw err;   
+        else if (!quiet) warn(err);
     }
     
     return trans;
 }
 
+mapnik::expression_ptr mss_parser::parse_expression(std::string const& str)
+{
+    profiler::count(profiler::expressions_parsed);
+    
+    return mapnik::parse_expression(str);
+}
+
 void mss_parser::key_error(std::string const& key, utree const& node) {
+    key_error(key, get_location(node));
+}
+
+void mss_parser::key_error(std::string const& key, source_location const& loc) {
     
     std::string str = "Unknown variable: @" + key; 
     
-    carto_error err(str, get_location(node));
+    carto_error err(str, loc);
     if (strict) throw err;
     else        warn(err);
 }
 
 void mss_parser::parse(mapnik::Map& map, style_env& env)
 {
+    profiler::timer timer("compile", path);
+    
+    env.vars.set_dependencies(deps);
+    
+    pending.clear();
+    definition_count = 0;
+    quiet = false;
+    
     try {
         parse_stylesheet(map, env);
+        emit_styles(map);
+    } catch(carto_error& e) {
+        pending.clear();
+        e.set_filename(path);
+        throw e;
+    }
+    
+    pending.clear();
+}
+
+// Adds the rules the cascade resolves the definitions of each style into
+void mss_parser::emit_styles(mapnik::Map& map)
+{
+    std::vector<std::string> const& styles = pending.styles();
+    std::vector<cascade::resolved_rule> rules;
+    
+    for (std::size_t i = 0; i != styles.size(); ++i) {
+        mapnik::Map::style_iterator map_it = map.styles().find(styles[i]);
+        BOOST_ASSERT(map_it != map.styles().end());
+        
+        rules.clear();
+        pending.resolve(styles[i], rules);
+        cascade::compact(rules);
+        
+        for (std::size_t r = 0; r != rules.size(); ++r) {
+            rule_builder& rule = rules[r].rule;
+            std::vector<definition const*> const& sources = rules[r].sources;
+            
+            // the least specific definition's declarations come first, so
+            // the rule starts out with its symbolizers; only those of the
+            // other definitions are applied again
+            rule.copy_symbolizers(sources.front()->symbolizers);
+            
+            quiet = true;
+            
+            for (std::size_t s = 1; s != sources.size(); ++s) {
+                std::vector<declaration> const& decls = sources[s]->declarations;
+                
+                for (std::size_t d = 0; d != decls.size(); ++d)
+                    apply_declaration(map, decls[d], rule);
+            }
+            
+            quiet = false;
+            
+            if (!rule.empty()) {
+                (*map_it).second.add_rule(rule.materialize());
+                profiler::count(profiler::rules_emitted);
+            }
+        }
+    }
+}
+
+// Replays only the top level variables and Map properties of the stylesheet,
+// used when its styles are already in the map and only its definitions are
+// needed by the stylesheets that follow it
+void mss_parser::parse_definitions(mapnik::Map& map, style_env& env)
+{
+    profiler::timer timer("definitions", path);
+    
+    env.vars.set_dependencies(deps);
+    
+    utree const& root_node = tree.ast();
+    
+    typedef utree::const_iterator iter;
+    iter it = root_node.begin(),
+        end = root_node.end();
+    
+    try {
+        for (; it != end; ++it) {
+            switch((carto_node_type) get_node_type(*it)) {
+                case CARTO_VARIABLE:
+                    parse_variable(*it,env);
+                    break;
+                case CARTO_MAP_STYLE:
+                    parse_map_style(map, *it, env);
+                    break;
+                default:
+                    break;
+            }
+        }
     } catch(carto_error& e) {
         e.set_filename(path);
         throw e;
@@ -180,7 +327,7 @@ void mss_parser::parse_stylesheet(mapnik::Map& map, style_env& env)
 }
 
 void mss_parser::parse_style(mapnik::Map& map, utree const& node, style_env const& parent_env, 
-                             mapnik::rule const& parent_rule, std::string const& parent_name)
+                             definition const& parent, std::string const& parent_name)
 {
     
     BOOST_ASSERT(node.size()==2);
@@ -192,7 +339,10 @@ void mss_parser::parse_style(mapnik::Map& map, utree const& node, style_env cons
     for (; style_it != style_end; ++style_it) {
         
         style_env env(parent_env);
-        mapnik::rule rule(parent_rule, true);
+        definition def;
+        def.filter = parent.filter;
+        def.rule = parent.rule;
+        def.filters = parent.filters;
         
         BOOST_ASSERT(*style_it.size() == 3);
         iter name_it  = (*style_it).begin(),
@@ -204,6 +354,8 @@ void mss_parser::parse_style(mapnik::Map& map, utree const& node, style_env cons
         
         std::string name = parent_name + as<std::string>(uname);
         
+        if (deps) deps->styles.insert(name);
+        
         mapnik::Map::style_iterator map_it, map_end;
         
         map_it  = map.styles().find(name);                           
@@ -221,15 +373,28 @@ void mss_parser::parse_style(mapnik::Map& map, utree const& node, style_env cons
         if (uattach.size() != 0) {
             name += "::"+as<std::string>(uattach);
             
+            if (deps) deps->styles.insert(name);
+            
             map.insert_style(name, mapnik::feature_type_style((*map_it).second, true));
             map_it = map.styles().find(name);
         }
         
+        // nested selectors that name a style of their own start out with
+        // what their parent declared so far; those of the same style take
+        // their parent's declarations in the cascade
+        if (name != parent_name) {
+            def.declarations = parent.declarations;
+            def.symbolizers = parent.symbolizers;
+        }
+        
         if (ufilter.size() != 0) {
             BOOST_ASSERT(get_node_type(ufilter) == CARTO_FILTER);
-            parse_filter(map, ufilter, env, rule);
+            parse_filter(map, ufilter, env, def);
+            def.filters += ufilter.size();
         }
         
+        def.spec = specificity(name, def.filters, definition_count++);
+        
         iter it  = node.back().begin(),
              end = node.back().end();
     
@@ -239,10 +404,10 @@ void mss_parser::parse_style(mapnik::Map& map, utree const& node, style_env cons
                     parse_variable(*it,env);
                     break;
                 case CARTO_STYLE:
-                    parse_style(map, *it, env, rule, name);
+                    parse_style(map, *it, env, def, name);
                     break;
                 case CARTO_ATTRIBUTE:
-                    parse_attribute(map, *it, env, rule);                    
+                    parse_attribute(map, *it, env, def);
                     break;
                 case CARTO_MIXIN:
                 case CARTO_COMMENT:
@@ -255,59 +420,57 @@ void mss_parser::parse_style(mapnik::Map& map, utree const& node, style_env cons
             }
         }
         
-        //mapnik::rules& rules = style->get_rules_nonconst();
-        if (rule.get_symbolizers().size() != 0) {
-            //rules[pos] = rule;
-            (*map_it).second.add_rule(rule);
-        } else {
-            //map.styles().erase(map_it);
-        }
-            
+        pending.add(name, def);
     }
 }
 
-void mss_parser::parse_filter(mapnik::Map& map, utree const& node, style_env const& env, mapnik::rule& rule)
+void mss_parser::parse_filter(mapnik::Map& map, utree const& node, style_env const& env, definition& def)
 {
     if (node.size() == 0) return;
     
-    std::string cur_filter = mapnik::to_expression_string(*rule.get_filter()),
-                out = (cur_filter != "true") ? "(" + cur_filter + ")" : "";
+    // the conditions of this selector only, those of the selectors it is
+    // nested in stay in the chain they are shared with
+    boost::optional<mapnik::expr_node> filter;
     
     utree::const_iterator it  = node.begin(),
                           end = node.end();
                           
     for (; it != end; ++it) 
     {
-        filter_printer printer(*it, tree.annotations(), env, rule);
-        std::string str = printer.print();
+        filter_printer printer(*it, tree.annotations(), env, def.rule, zooms);
+        boost::optional<mapnik::expr_node> expr = printer.generate();
         
-        if (str.empty()) continue;
+        if (!expr) continue;
         
-        out += (!out.empty() ? " and " : "") + str;
+        if (filter)
+            append_operand<mapnik::tags::logical_and>(*filter, *expr);
+        else
+            filter = expr;
     }
     
-    if (!out.empty()) {
-        mapnik::expression_ptr expr = mapnik::parse_expression(out,"utf8");
-        rule.set_filter(expr);
-    } 
+    if (filter)
+        def.filter = filter_chain(def.filter, *filter);
 }
 
-utree mss_parser::eval_var(utree const& node, style_env const& env) {
-    std::string key = as<std::string>(node.front());
+// loc is where the variable is used; a variable whose value is another
+// variable is reported where it was defined, its value is a copy that has
+// no location of its own
+utree mss_parser::eval_var(utree const& node, style_env const& env, source_location const& loc) {
+    symbol_id id = env.vars.intern(node);
     
-    utree value = env.vars.lookup(key);
+    utree value = env.vars.lookup(id);
     
     if (value == utree::nil_type()) {
-        key_error(key, node);
+        key_error(env.vars.name(id), loc);
     }
     
-    return (get_node_type(value) == CARTO_VARIABLE) ? eval_var(value,env) : value;
+    return (get_node_type(value) == CARTO_VARIABLE) ? eval_var(value, env, env.vars.location(id)) : value;
 }
 
 utree mss_parser::parse_value(utree const& node, style_env const& env) 
 {
     if (get_node_type(node) == CARTO_VARIABLE) {
-        return eval_var(node, env); // vars can point at other vars
+        return eval_var(node, env, get_location(node)); // vars can point at other vars
     } else if (get_node_type(node) == CARTO_EXPRESSION) {
         //BOOST_ASSERT(node.size()==1);
         expression exp(node.front().front(), tree.annotations(), env);
@@ -320,385 +483,518 @@ utree mss_parser::parse_value(utree const& node, style_env const& env)
     }
 }
 
-void mss_parser::parse_attribute(mapnik::Map& map, utree const& node, style_env const& env, mapnik::rule& rule) 
+void mss_parser::parse_attribute(mapnik::Map& map, utree const& node, style_env const& env, definition& def)
 {
     BOOST_ASSERT(node.size()==2);
-    
-    std::string key = as<std::string>(node.front());
+
     utree value = parse_value(node.back(), env);
-    
-    if (key.substr(0,8) == "polygon-")
-        parse_polygon(rule,key,value,env);
-    else if (key.substr(0,5) == "line-")  
-        parse_line(rule,key,value,env);
-    else if (key.substr(0,7) == "marker-")
-        parse_marker(rule,key,value,env);
-    else if (key.substr(0,6) == "point-")
-        parse_point(rule,key,value,env);
-    else if (key.substr(0,13)== "line-pattern-")
-        parse_line_pattern(rule,key,value,env);
-    else if (key.substr(0,16)== "polygon-pattern-") 
-        parse_polygon_pattern(rule,key,value,env);
-    else if (key.substr(0,7) == "raster-")
-        parse_raster(rule,key,value,env);
-    else if (key.substr(0,9) == "building-")
-        parse_building(rule,key,value,env);
-    else if (key.substr(0,5) == "text-")
-        parse_text(map,rule,key,value,env);
-    else if (key.substr(0,7) == "shield-")
-        parse_shield(rule,key,value,env);
-    else 
-        key_error(key, node);
-}
-
-bool mss_parser::parse_polygon(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env) 
+    property const* prop = find_property(node.front());
+
+    if (!prop) {
+        key_error(as<std::string>(node.front()), node);
+        return;
+    }
+
+    def.declarations.push_back(declaration(prop, value, get_location(node)));
+    apply_declaration(map, def.declarations.back(), def.symbolizers);
+}
+
+void mss_parser::apply_declaration(mapnik::Map& map, declaration const& decl, rule_builder& rule)
+{
+    property const* prop = decl.prop;
+    utree const& value = decl.value;
+
+    switch (prop->symbolizer) {
+        case POLYGON_SYMBOLIZER:
+            parse_polygon(rule,prop->type,value);
+            break;
+        case LINE_SYMBOLIZER:
+            parse_line(rule,prop->type,value);
+            break;
+        case MARKERS_SYMBOLIZER:
+            parse_marker(rule,prop->type,value,decl.loc);
+            break;
+        case POINT_SYMBOLIZER:
+            parse_point(rule,prop->type,value,decl.loc);
+            break;
+        case LINE_PATTERN_SYMBOLIZER:
+            parse_line_pattern(rule,prop->type,value);
+            break;
+        case POLYGON_PATTERN_SYMBOLIZER:
+            parse_polygon_pattern(rule,prop->type,value);
+            break;
+        case RASTER_SYMBOLIZER:
+            parse_raster(rule,prop->type,value,decl.loc);
+            break;
+        case BUILDING_SYMBOLIZER:
+            parse_building(rule,prop->type,value);
+            break;
+        case TEXT_SYMBOLIZER:
+            parse_text(map,rule,prop->type,value);
+            break;
+        case SHIELD_SYMBOLIZER:
+            parse_shield(rule,prop->type,value);
+            break;
+    }
+}
+
+bool mss_parser::parse_polygon(rule_builder& rule, property_type prop, utree const& value)
 {
     mapnik::polygon_symbolizer *s = find_symbolizer<mapnik::polygon_symbolizer>(rule);
-    
-    if (key == "polygon-fill") {
-        s->set_fill(as<mapnik::color>(value));
-    } else if (key == "polygon-gamma") {
-        s->set_gamma(as<double>(value));
-    } else if (key == "polygon-opacity") {
-        s->set_opacity(as<double>(value));
-    } else {
-        return false;
+
+    switch (prop) {
+        case PROP_POLYGON_FILL:
+            s->set_fill(as<mapnik::color>(value));
+            break;
+        case PROP_POLYGON_GAMMA:
+            s->set_gamma(as<double>(value));
+            break;
+        case PROP_POLYGON_OPACITY:
+            s->set_opacity(as<double>(value));
+            break;
+        default:
+            return false;
     }
     return true;
 }
 
-bool mss_parser::parse_line(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env) 
+bool mss_parser::parse_line(rule_builder& rule, property_type prop, utree const& value)
 {
     mapnik::line_symbolizer *s = find_symbolizer<mapnik::line_symbolizer>(rule);
     mapnik::stroke strk = s->get_stroke();
-    
-    if (key == "line-dasharray") {
-        
-        BOOST_ASSERT( (value.size()-1) % 2 == 0 );
-        
-        typedef utree::const_iterator iter;
-        iter it = value.begin(),
-            end = value.end();
-        
-        for(; it!=end;) {
-            double dash = as<double>(*it); it++;
-            double gap  = as<double>(*it); it++;
-            
-            strk.add_dash(dash,gap);
+
+    switch (prop) {
+        case PROP_LINE_DASHARRAY:
+        {
+            BOOST_ASSERT( (value.size()-1) % 2 == 0 );
+
+            typedef utree::const_iterator iter;
+            iter it = value.begin(),
+                end = value.end();
+
+            for(; it!=end;) {
+                double dash = as<double>(*it); it++;
+                double gap  = as<double>(*it); it++;
+
+                strk.add_dash(dash,gap);
+            }
+            break;
         }
-    } else if (key == "line-color") {
-        strk.set_color(as<mapnik::color>(value));
-    } else if (key == "line-width") {
-        strk.set_width(as<double>(value));
-    } else if (key == "line-opacity") {
-        strk.set_opacity(as<double>(value));
-    } else if (key == "line-join") {
-        mapnik::line_join_e en;
-        en.from_string(as<std::string>(value));
-        strk.set_line_join(en);
-    } else if (key == "line-cap") {
-        mapnik::line_cap_e en;
-        en.from_string(as<std::string>(value));
-        strk.set_line_cap(en);
-    } else if (key == "line-gamma") {
-        strk.set_gamma(as<double>(value));
-    } else if (key == "line-dash-offset") {
-        strk.set_dash_offset(as<double>(value));
-    } else {
-        return false;
+        case PROP_LINE_COLOR:
+            strk.set_color(as<mapnik::color>(value));
+            break;
+        case PROP_LINE_WIDTH:
+            strk.set_width(as<double>(value));
+            break;
+        case PROP_LINE_OPACITY:
+            strk.set_opacity(as<double>(value));
+            break;
+        case PROP_LINE_JOIN:
+        {
+            mapnik::line_join_e en;
+            en.from_string(as<std::string>(value));
+            strk.set_line_join(en);
+            break;
+        }
+        case PROP_LINE_CAP:
+        {
+            mapnik::line_cap_e en;
+            en.from_string(as<std::string>(value));
+            strk.set_line_cap(en);
+            break;
+        }
+        case PROP_LINE_GAMMA:
+            strk.set_gamma(as<double>(value));
+            break;
+        case PROP_LINE_DASH_OFFSET:
+            strk.set_dash_offset(as<double>(value));
+            break;
+        default:
+            return false;
     }
     s->set_stroke(strk);
     return true;
 }
 
-bool mss_parser::parse_marker(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env) 
+bool mss_parser::parse_marker(rule_builder& rule, property_type prop, utree const& value, source_location const& loc)
 {
-    mapnik::markers_symbolizer *s = find_symbolizer<mapnik::markers_symbolizer>(rule); 
+    mapnik::markers_symbolizer *s = find_symbolizer<mapnik::markers_symbolizer>(rule);
     boost::optional<mapnik::stroke> stroke = s->get_stroke();
 
-    if (key == "marker-file") {
-        s->set_filename(mapnik::parse_path(as<std::string>(value)));
-    } else if (key == "marker-opacity") {
-        s->set_opacity(as<float>(value));
-    } else if (key == "marker-placement") {
-        mapnik::marker_placement_e en;
-        en.from_string(as<std::string>(value));
-        s->set_marker_placement(en);
-    //} else if (key == "marker-type") {
-    //    mapnik::marker_type_e en;
-    //    en.from_string(as<std::string>(value));
-    //    s->set_marker_type(en);
-    } else if (key == "marker-width") {
-        s->set_width(mapnik::parse_expression(as<std::string>(value)));
-    } else if (key == "marker-height") {
-        s->set_height(mapnik::parse_expression(as<std::string>(value)));
-    } else if (key == "marker-fill") {
-        s->set_fill(as<mapnik::color>(value));
-    } else if (key == "marker-allow-overlap") {
-        s->set_allow_overlap(as<bool>(value));
-    } else if (key == "marker-spacing") {
-        s->set_spacing(as<double>(value));
-    } else if (key == "marker-max-error") {
-        s->set_max_error(as<double>(value));
-    } else if (key == "marker-transform") {
-        s->set_transform(create_transform(as<std::string>(value), value));
-    } else if (key == "marker-line-color" && stroke) {
-        (*stroke).set_color(as<mapnik::color>(value));
-    } else if (key == "marker-line-width" && stroke) {
-        (*stroke).set_width(as<double>(value));
-    } else if (key == "marker-line-opacity" && stroke) {
-        (*stroke).set_opacity(as<double>(value));
-    } else {
-        return false;
+    switch (prop) {
+        case PROP_MARKER_FILE:
+            s->set_filename(mapnik::parse_path(as<std::string>(value)));
+            break;
+        case PROP_MARKER_OPACITY:
+            s->set_opacity(as<float>(value));
+            break;
+        case PROP_MARKER_PLACEMENT:
+        {
+            mapnik::marker_placement_e en;
+            en.from_string(as<std::string>(value));
+            s->set_marker_placement(en);
+            break;
+        }
+        case PROP_MARKER_TYPE:
+            // accepted but ignored, this version of mapnik can't set it
+            //mapnik::marker_type_e en;
+            //en.from_string(as<std::string>(value));
+            //s->set_marker_type(en);
+            return false;
+        case PROP_MARKER_WIDTH:
+            s->set_width(parse_expression(as<std::string>(value)));
+            break;
+        case PROP_MARKER_HEIGHT:
+            s->set_height(parse_expression(as<std::string>(value)));
+            break;
+        case PROP_MARKER_FILL:
+            s->set_fill(as<mapnik::color>(value));
+            break;
+        case PROP_MARKER_ALLOW_OVERLAP:
+            s->set_allow_overlap(as<bool>(value));
+            break;
+        case PROP_MARKER_SPACING:
+            s->set_spacing(as<double>(value));
+            break;
+        case PROP_MARKER_MAX_ERROR:
+            s->set_max_error(as<double>(value));
+            break;
+        case PROP_MARKER_TRANSFORM:
+            s->set_transform(create_transform(as<std::string>(value), loc));
+            break;
+        case PROP_MARKER_LINE_COLOR:
+            if (!stroke) return false;
+            (*stroke).set_color(as<mapnik::color>(value));
+            break;
+        case PROP_MARKER_LINE_WIDTH:
+            if (!stroke) return false;
+            (*stroke).set_width(as<double>(value));
+            break;
+        case PROP_MARKER_LINE_OPACITY:
+            if (!stroke) return false;
+            (*stroke).set_opacity(as<double>(value));
+            break;
+        default:
+            return false;
     }
-    
+
     return true;
 }
 
-bool mss_parser::parse_point(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env) 
+bool mss_parser::parse_point(rule_builder& rule, property_type prop, utree const& value, source_location const& loc)
 {
     mapnik::point_symbolizer *s = find_symbolizer<mapnik::point_symbolizer>(rule);
-    
-    if (key == "point-file") {
-        s->set_filename(mapnik::parse_path(as<std::string>(value)));
-    } else if (key == "point-allow-overlap") {
-        s->set_allow_overlap(as<bool>(value));
-    } else if (key == "point-ignore-placement") {
-        s->set_ignore_placement(as<bool>(value));
-    } else if (key == "point-opacity") {
-        s->set_opacity(as<float>(value));
-    } else if (key == "point-placement") {
-        mapnik::point_placement_e en;
-        en.from_string(as<std::string>(value));
-        s->set_point_placement(en);
-    } else if (key == "point-transform") {
-        s->set_transform(create_transform(as<std::string>(value), value));
-    } else {
-        return false;
+
+    switch (prop) {
+        case PROP_POINT_FILE:
+            s->set_filename(mapnik::parse_path(as<std::string>(value)));
+            break;
+        case PROP_POINT_ALLOW_OVERLAP:
+            s->set_allow_overlap(as<bool>(value));
+            break;
+        case PROP_POINT_IGNORE_PLACEMENT:
+            s->set_ignore_placement(as<bool>(value));
+            break;
+        case PROP_POINT_OPACITY:
+            s->set_opacity(as<float>(value));
+            break;
+        case PROP_POINT_PLACEMENT:
+        {
+            mapnik::point_placement_e en;
+            en.from_string(as<std::string>(value));
+            s->set_point_placement(en);
+            break;
+        }
+        case PROP_POINT_TRANSFORM:
+            s->set_transform(create_transform(as<std::string>(value), loc));
+            break;
+        default:
+            return false;
     }
     return true;
 }
 
-bool mss_parser::parse_line_pattern(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env) 
+bool mss_parser::parse_line_pattern(rule_builder& rule, property_type prop, utree const& value)
 {
     mapnik::line_pattern_symbolizer *s = find_symbolizer<mapnik::line_pattern_symbolizer>(rule);
-    
-    if (key == "line-pattern-file") {
-        s->set_filename(mapnik::parse_path(as<std::string>(value)));
-    } else {
-        return false;
+
+    switch (prop) {
+        case PROP_LINE_PATTERN_FILE:
+            s->set_filename(mapnik::parse_path(as<std::string>(value)));
+            break;
+        default:
+            return false;
     }
     return true;
 }
 
-bool mss_parser::parse_polygon_pattern(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env) 
+bool mss_parser::parse_polygon_pattern(rule_builder& rule, property_type prop, utree const& value)
 {
     mapnik::polygon_pattern_symbolizer *s = find_symbolizer<mapnik::polygon_pattern_symbolizer>(rule);
-    
-    if (key == "polygon-pattern-file") {
-        s->set_filename(mapnik::parse_path(as<std::string>(value)));
-    } else if (key == "polygon-pattern-alignment") {
-        mapnik::pattern_alignment_e en;
-        en.from_string(as<std::string>(value));
-        s->set_alignment(en);
-    } else {
-        return false;
+
+    switch (prop) {
+        case PROP_POLYGON_PATTERN_FILE:
+            s->set_filename(mapnik::parse_path(as<std::string>(value)));
+            break;
+        case PROP_POLYGON_PATTERN_ALIGNMENT:
+        {
+            mapnik::pattern_alignment_e en;
+            en.from_string(as<std::string>(value));
+            s->set_alignment(en);
+            break;
+        }
+        default:
+            return false;
     }
     return true;
 }
 
-bool mss_parser::parse_raster(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env) 
+bool mss_parser::parse_raster(rule_builder& rule, property_type prop, utree const& value, source_location const& loc)
 {
     mapnik::raster_symbolizer *s = find_symbolizer<mapnik::raster_symbolizer>(rule);
-    
-    if (key == "raster-opacity") {
-        s->set_opacity(as<float>(value));
-    } else if (key == "raster-mode") {
-        s->set_mode(as<std::string>(value));
-    } else if (key == "raster-scaling") {
 
-        std::string str( as<std::string>(value) );
-        boost::optional<mapnik::scaling_method_e> sm = mapnik::scaling_method_from_string(str);
+    switch (prop) {
+        case PROP_RASTER_OPACITY:
+            s->set_opacity(as<float>(value));
+            break;
+        case PROP_RASTER_MODE:
+            s->set_mode(as<std::string>(value));
+            break;
+        case PROP_RASTER_SCALING:
+        {
+            std::string str( as<std::string>(value) );
+            boost::optional<mapnik::scaling_method_e> sm = mapnik::scaling_method_from_string(str);
 
-        if (sm){
-            s->set_scaling_method(*sm);
-        } else {
-            std::stringstream ss;
-            ss << "Invalid scaling method '" << str << "'";
-            
-            carto_error err(ss.str(), get_location(value));
-            if (strict) throw err;
-            else        warn(err);
-        }
+            if (sm){
+                s->set_scaling_method(*sm);
+            } else {
+                std::stringstream ss;
+                ss << "Invalid scaling method '" << str << "'";
 
-    } else {
-        return false;
+                carto_error err(ss.str(), loc);
+                if (strict)      throw err;
+                else if (!quiet) warn(err);
+            }
+            break;
+        }
+        default:
+            return false;
     }
     return true;
 }
 
-bool mss_parser::parse_building(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env) 
+bool mss_parser::parse_building(rule_builder& rule, property_type prop, utree const& value)
 {
     mapnik::building_symbolizer *s = find_symbolizer<mapnik::building_symbolizer>(rule);
-    
-    if (key == "building-fill") {
-        s->set_fill(as<mapnik::color>(value));
-    } else if (key == "building-fill-opacity") {
-        s->set_opacity(as<double>(value));
-    } else if (key == "building-height") {
-        s->set_height(mapnik::parse_expression(as<std::string>(value)));
-    } else {
-        return false;
+
+    switch (prop) {
+        case PROP_BUILDING_FILL:
+            s->set_fill(as<mapnik::color>(value));
+            break;
+        case PROP_BUILDING_FILL_OPACITY:
+            s->set_opacity(as<double>(value));
+            break;
+        case PROP_BUILDING_HEIGHT:
+            s->set_height(parse_expression(as<std::string>(value)));
+            break;
+        default:
+            return false;
     }
     return true;
 }
 
-bool mss_parser::parse_text(mapnik::Map& map, mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env) 
+bool mss_parser::parse_text(mapnik::Map& map, rule_builder& rule, property_type prop, utree const& value)
 {
     mapnik::text_symbolizer *s = find_symbolizer<mapnik::text_symbolizer>(rule);
-    
+
     using boost::spirit::utree_type;
-    
-    if (key == "text-face-name") {
-        if (value.which() != utree_type::list_type) {
-            s->set_face_name(as<std::string>(value));
-        } else {
-            
-            mapnik::font_set fs;
-            std::size_t hash = 0;
-            
-            typedef utree::const_iterator iter;
-            iter it = value.begin(),
-                end = value.end();
-            
-            for( ; it!=end; ++it) {
-                std::string str = as<std::string>(*it);
-                boost::hash_combine(hash, str);
-                fs.add_face_name(str);
+
+    switch (prop) {
+        case PROP_TEXT_FACE_NAME:
+            if (value.which() != utree_type::list_type) {
+                s->set_face_name(as<std::string>(value));
+            } else {
+
+                mapnik::font_set fs;
+                std::size_t hash = 0;
+
+                typedef utree::const_iterator iter;
+                iter it = value.begin(),
+                    end = value.end();
+
+                for( ; it!=end; ++it) {
+                    std::string str = as<std::string>(*it);
+                    boost::hash_combine(hash, str);
+                    fs.add_face_name(str);
+                }
+
+                fs.set_name( get_fontset_name(hash) );
+
+                s->set_fontset(fs);
+                s->set_face_name(std::string());
+                map.insert_fontset(fs.get_name(), fs);
             }
-            
-            fs.set_name( get_fontset_name(hash) );
-            
-            s->set_fontset(fs);
-            s->set_face_name(std::string());
-            map.insert_fontset(fs.get_name(), fs);
+            break;
+        case PROP_TEXT_NAME:
+            s->set_name(parse_expression(as<std::string>(value)));
+            break;
+        case PROP_TEXT_SIZE:
+            s->set_text_size(round(as<double>(value)));
+            break;
+        case PROP_TEXT_RATIO:
+            s->set_text_ratio(round(as<double>(value)));
+            break;
+        case PROP_TEXT_WRAP_WIDTH:
+            s->set_wrap_width(round(as<double>(value)));
+            break;
+        case PROP_TEXT_SPACING:
+            s->set_label_spacing(round(as<double>(value)));
+            break;
+        case PROP_TEXT_CHARACTER_SPACING:
+            s->set_character_spacing(round(as<double>(value)));
+            break;
+        case PROP_TEXT_LINE_SPACING:
+            s->set_line_spacing(round(as<double>(value)));
+            break;
+        case PROP_TEXT_LABEL_POSITION_TOLERANCE:
+            s->set_label_position_tolerance(round(as<double>(value)));
+            break;
+        case PROP_TEXT_MAX_CHAR_ANGLE_DELTA:
+            s->set_max_char_angle_delta(as<double>(value));
+            break;
+        case PROP_TEXT_FILL:
+            s->set_fill(as<mapnik::color>(value));
+            break;
+        case PROP_TEXT_OPACITY:
+            s->set_text_opacity(as<double>(value));
+            break;
+        case PROP_TEXT_HALO_FILL:
+            s->set_halo_fill(as<mapnik::color>(value));
+            break;
+        case PROP_TEXT_HALO_RADIUS:
+            s->set_halo_radius(as<double>(value));
+            break;
+        case PROP_TEXT_DX:
+        case PROP_TEXT_DY:
+            // accepted but ignored, this version of mapnik can't set them
+            //double x = as<double>(value);
+            //double y = s->get_displacement().second;
+            //s->set_displacement(x,y);
+            return false;
+        case PROP_TEXT_VERTICAL_ALIGNMENT:
+        {
+            mapnik::vertical_alignment_e en;
+            en.from_string(as<std::string>(value));
+            s->set_vertical_alignment(en);
+            break;
         }
-    } else if (key == "text-name") {
-        s->set_name(mapnik::parse_expression(as<std::string>(value)));
-    } else if (key == "text-size") {
-        s->set_text_size(round(as<double>(value)));
-    } else if (key == "text-ratio") {
-        s->set_text_ratio(round(as<double>(value)));
-    } else if (key == "text-wrap-width") {
-        s->set_wrap_width(round(as<double>(value)));
-    } else if (key == "text-spacing") {
-        s->set_label_spacing(round(as<double>(value)));
-    } else if (key == "text-character-spacing") {
-        s->set_character_spacing(round(as<double>(value)));
-    } else if (key == "text-line-spacing") {
-        s->set_line_spacing(round(as<double>(value)));
-    } else if (key == "text-label-position-tolerance") {
-        s->set_label_position_tolerance(round(as<double>(value)));
-    } else if (key == "text-max-char-angle-delta") {
-        s->set_max_char_angle_delta(as<double>(value));
-    } else if (key == "text-fill") {
-        s->set_fill(as<mapnik::color>(value));
-    } else if (key == "text-opacity") {
-        s->set_text_opacity(as<double>(value));
-    } else if (key == "text-halo-fill") {
-        s->set_halo_fill(as<mapnik::color>(value));
-    } else if (key == "text-halo-radius") {
-        s->set_halo_radius(as<double>(value));
-    //} else if (key == "text-dx") {
-    //    double x = as<double>(value);
-    //    double y = s->get_displacement().second;
-    //    s->set_displacement(x,y);
-    //} else if (key == "text-dy") {
-    //    double x = s->get_displacement().first;
-    //    double y = as<double>(value);
-    //    s->set_displacement(x,y);
-    } else if (key == "text-vertical-alignment") {
-        mapnik::vertical_alignment_e en;
-        en.from_string(as<std::string>(value));
-        s->set_vertical_alignment(en);
-    } else if (key == "text-avoid-edges") {
-        s->set_avoid_edges(as<bool>(value));
-    } else if (key == "text-min-distance") {
-        s->set_minimum_distance(as<double>(value));
-    } else if (key == "text-min-padding") {
-        s->set_minimum_padding(as<double>(value));
-    } else if (key == "text-allow-overlap") {
-        s->set_allow_overlap(as<bool>(value));
-    } else if (key == "text-placement") {
-        mapnik::label_placement_e en;
-        en.from_string(as<std::string>(value));
-        s->set_label_placement(en);
-    } else if (key == "text-placement-type") {
-        // FIXME
-    } else if (key == "text-placements") {
-        // FIXME
-    } else if (key == "text-transform") {
-        mapnik::text_transform_e en;
-        en.from_string(as<std::string>(value));
-        s->set_text_transform(en);
-    } else {
-        return false;
+        case PROP_TEXT_AVOID_EDGES:
+            s->set_avoid_edges(as<bool>(value));
+            break;
+        case PROP_TEXT_MIN_DISTANCE:
+            s->set_minimum_distance(as<double>(value));
+            break;
+        case PROP_TEXT_MIN_PADDING:
+            s->set_minimum_padding(as<double>(value));
+            break;
+        case PROP_TEXT_ALLOW_OVERLAP:
+            s->set_allow_overlap(as<bool>(value));
+            break;
+        case PROP_TEXT_PLACEMENT:
+        {
+            mapnik::label_placement_e en;
+            en.from_string(as<std::string>(value));
+            s->set_label_placement(en);
+            break;
+        }
+        case PROP_TEXT_PLACEMENT_TYPE:
+            // FIXME
+            break;
+        case PROP_TEXT_PLACEMENTS:
+            // FIXME
+            break;
+        case PROP_TEXT_TRANSFORM:
+        {
+            mapnik::text_transform_e en;
+            en.from_string(as<std::string>(value));
+            s->set_text_transform(en);
+            break;
+        }
+        default:
+            return false;
     }
     return true;
 }
 
 
-bool mss_parser::parse_shield(mapnik::rule& rule, std::string const& key, utree const& value, style_env const& env) 
+bool mss_parser::parse_shield(rule_builder& rule, property_type prop, utree const& value)
 {
     mapnik::shield_symbolizer *s = find_symbolizer<mapnik::shield_symbolizer>(rule);
-    
-    if (key == "shield-name") {
-        s->set_name(mapnik::parse_expression(as<std::string>(value)));
-    } else if (key == "shield-face-name") {
-        s->set_face_name(as<std::string>(value));
-    } else if (key == "shield-size") {
-        s->set_text_size(round(as<double>(value)));
-    } else if (key == "shield-spacing") {
-        s->set_label_spacing(round(as<double>(value)));
-    } else if (key == "shield-character-spacing") {
-        s->set_character_spacing(round(as<double>(value)));
-    } else if (key == "shield-line-spacing") {
-        s->set_line_spacing(round(as<double>(value)));
-    } else if (key == "shield-fill") {
-        s->set_fill(as<mapnik::color>(value));
-    //} else if (key == "shield-text-dx") {
-    //    double x = as<double>(value);
-    //    double y = s->get_displacement().second;
-    //    s->set_displacement(x,y);
-    //} else if (key == "shield-text-dy") {
-    //    double x = s->get_displacement().first;
-    //    double y = as<double>(value);
-    //    s->set_displacement(x,y);
-    } else if (key == "shield-dx") {
-        double x = as<double>(value);
-        double y = s->get_shield_displacement().second;
-        s->set_shield_displacement(x,y);
-    } else if (key == "shield-dy") {
-        double x = s->get_shield_displacement().first;
-        double y = as<double>(value);
-        s->set_shield_displacement(x,y);
-    } else if (key == "shield-min-distance") {
-        s->set_minimum_distance(as<double>(value));
-    } else if (key == "shield-placement") {
-        mapnik::label_placement_e en;
-        en.from_string(as<std::string>(value));
-        s->set_label_placement(en);
-    } else {
-        return false;
+
+    switch (prop) {
+        case PROP_SHIELD_NAME:
+            s->set_name(parse_expression(as<std::string>(value)));
+            break;
+        case PROP_SHIELD_FACE_NAME:
+            s->set_face_name(as<std::string>(value));
+            break;
+        case PROP_SHIELD_SIZE:
+            s->set_text_size(round(as<double>(value)));
+            break;
+        case PROP_SHIELD_SPACING:
+            s->set_label_spacing(round(as<double>(value)));
+            break;
+        case PROP_SHIELD_CHARACTER_SPACING:
+            s->set_character_spacing(round(as<double>(value)));
+            break;
+        case PROP_SHIELD_LINE_SPACING:
+            s->set_line_spacing(round(as<double>(value)));
+            break;
+        case PROP_SHIELD_FILL:
+            s->set_fill(as<mapnik::color>(value));
+            break;
+        case PROP_SHIELD_TEXT_DX:
+        case PROP_SHIELD_TEXT_DY:
+            // accepted but ignored, this version of mapnik can't set them
+            //double x = as<double>(value);
+            //double y = s->get_displacement().second;
+            //s->set_displacement(x,y);
+            return false;
+        case PROP_SHIELD_DX:
+        {
+            double x = as<double>(value);
+            double y = s->get_shield_displacement().second;
+            s->set_shield_displacement(x,y);
+            break;
+        }
+        case PROP_SHIELD_DY:
+        {
+            double x = s->get_shield_displacement().first;
+            double y = as<double>(value);
+            s->set_shield_displacement(x,y);
+            break;
+        }
+        case PROP_SHIELD_MIN_DISTANCE:
+            s->set_minimum_distance(as<double>(value));
+            break;
+        case PROP_SHIELD_PLACEMENT:
+        {
+            mapnik::label_placement_e en;
+            en.from_string(as<std::string>(value));
+            s->set_label_placement(en);
+            break;
+        }
+        default:
+            return false;
     }
     return true;
 }
 
 void mss_parser::parse_variable(utree const& node, style_env& env)
 {
-    std::string name = as<std::string>(node.front());
+    symbol_id id = env.vars.intern(node.front());
     utree val = parse_value(node.back(), env);
-    env.vars.define(name, val);
+    env.vars.define(id, val, get_location(node));
 }
 
 void mss_parser::parse_map_style(mapnik::Map& map, utree const& node, style_env& env) 
@@ -744,7 +1040,7 @@ void mss_parser::parse_map_style(mapnik::Map& map, utree const& node, style_env&
             int min_ver = version_from_string(ver_str);
             
             if (min_ver == -1 && strict) {
-                throw carto_error(std::string("Invalid version string ") + ver_str, get_location(value));
+                throw carto_error(std::string("Invalid version string ") + ver_str, get_location((*it).back()));
             } else if (min_ver > MAPNIK_VERSION) {
                 throw carto_error(std::string("This map uses features only present in Mapnik version ") + ver_str + " and newer");
             }
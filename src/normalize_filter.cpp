@@ -0,0 +1,359 @@
+#include <generate/normalize_filter.hpp>
+#include <generate/generate_filter.hpp>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <mapnik/value.hpp>
+#include <mapnik/attribute.hpp>
+#include <mapnik/expression_string.hpp>
+
+namespace carto {
+
+namespace {
+
+using mapnik::expr_node;
+
+typedef mapnik::binary_node<mapnik::tags::logical_and> and_node;
+typedef mapnik::binary_node<mapnik::tags::logical_or> or_node;
+typedef mapnik::unary_node<mapnik::tags::logical_not> not_node;
+
+bool constant(expr_node const& node, bool& value)
+{
+    mapnik::value const* v = boost::get<mapnik::value>(&node);
+    if (!v)
+        return false;
+
+    bool const* b = boost::get<bool>(&v->base());
+    if (!b)
+        return false;
+
+    value = *b;
+    return true;
+}
+
+expr_node constant_node(bool value)
+{
+    return expr_node(mapnik::value(value));
+}
+
+template<class Tag>
+bool binary_cost(expr_node const& node, int& cost);
+
+// a rough count of the work evaluating a node takes, regular expressions
+// weigh most
+int cost(expr_node const& node)
+{
+    if (boost::get<mapnik::value>(&node) || boost::get<mapnik::attribute>(&node))
+        return 0;
+
+    if (mapnik::regex_match_node const* n = boost::get<mapnik::regex_match_node>(&node))
+        return 8 + cost(n->expr);
+    if (mapnik::regex_replace_node const* n = boost::get<mapnik::regex_replace_node>(&node))
+        return 8 + cost(n->expr);
+    if (not_node const* n = boost::get<not_node>(&node))
+        return cost(n->expr);
+
+    int c = 1;
+
+    binary_cost<mapnik::tags::equal_to>(node, c)
+        || binary_cost<mapnik::tags::not_equal_to>(node, c)
+        || binary_cost<mapnik::tags::less>(node, c)
+        || binary_cost<mapnik::tags::less_equal>(node, c)
+        || binary_cost<mapnik::tags::greater>(node, c)
+        || binary_cost<mapnik::tags::greater_equal>(node, c)
+        || binary_cost<mapnik::tags::logical_and>(node, c)
+        || binary_cost<mapnik::tags::logical_or>(node, c);
+
+    return c;
+}
+
+template<class Tag>
+bool binary_cost(expr_node const& node, int& c)
+{
+    mapnik::binary_node<Tag> const* n = boost::get< mapnik::binary_node<Tag> >(&node);
+    if (!n)
+        return false;
+
+    c = 1 + cost(n->left) + cost(n->right);
+    return true;
+}
+
+// What an and of comparisons requires of one attribute: an interval for
+// numbers, numbers it must differ from, and for strings the one it has to
+// equal and those it must not.
+struct attribute_bounds {
+    bool has_lo, lo_strict, has_hi, hi_strict;
+    double lo, hi;
+    std::vector<double> excluded;
+
+    bool has_string;
+    std::string string;
+    std::set<std::string> excluded_strings;
+
+    bool contradicted;
+
+    attribute_bounds()
+      : has_lo(false), lo_strict(false), has_hi(false), hi_strict(false),
+        lo(0), hi(0), excluded(),
+        has_string(false), string(), excluded_strings(),
+        contradicted(false) { }
+
+    void lower(double n, bool strict)
+    {
+        if (!has_lo || n > lo || (n == lo && strict)) {
+            has_lo = true;
+            lo = n;
+            lo_strict = strict;
+        }
+    }
+
+    void upper(double n, bool strict)
+    {
+        if (!has_hi || n < hi || (n == hi && strict)) {
+            has_hi = true;
+            hi = n;
+            hi_strict = strict;
+        }
+    }
+
+    void equal(std::string const& str)
+    {
+        if (has_string && string != str)
+            contradicted = true;
+
+        has_string = true;
+        string = str;
+    }
+
+    bool satisfiable() const
+    {
+        if (contradicted)
+            return false;
+
+        if (has_string && excluded_strings.count(string))
+            return false;
+
+        if (has_lo && has_hi) {
+            if (lo > hi || (lo == hi && (lo_strict || hi_strict)))
+                return false;
+
+            if (lo == hi && std::find(excluded.begin(), excluded.end(), lo) != excluded.end())
+                return false;
+        }
+
+        return true;
+    }
+};
+
+enum comparison_kind { CMP_EQ, CMP_NEQ, CMP_LT, CMP_LE, CMP_GT, CMP_GE };
+
+template<class Tag>
+bool attribute_comparison(expr_node const& node, std::string& name, expr_node const*& literal)
+{
+    mapnik::binary_node<Tag> const* n = boost::get< mapnik::binary_node<Tag> >(&node);
+    if (!n)
+        return false;
+
+    mapnik::attribute const* attr = boost::get<mapnik::attribute>(&n->left);
+    if (!attr || !boost::get<mapnik::value>(&n->right))
+        return false;
+
+    name = attr->name();
+    literal = &n->right;
+    return true;
+}
+
+bool comparison(expr_node const& node, comparison_kind& kind, std::string& name, expr_node const*& literal)
+{
+    if (attribute_comparison<mapnik::tags::equal_to>(node, name, literal))
+        kind = CMP_EQ;
+    else if (attribute_comparison<mapnik::tags::not_equal_to>(node, name, literal))
+        kind = CMP_NEQ;
+    else if (attribute_comparison<mapnik::tags::less>(node, name, literal))
+        kind = CMP_LT;
+    else if (attribute_comparison<mapnik::tags::less_equal>(node, name, literal))
+        kind = CMP_LE;
+    else if (attribute_comparison<mapnik::tags::greater>(node, name, literal))
+        kind = CMP_GT;
+    else if (attribute_comparison<mapnik::tags::greater_equal>(node, name, literal))
+        kind = CMP_GE;
+    else
+        return false;
+
+    return true;
+}
+
+// whether no feature can satisfy all of the and-ed operands
+bool contradictory(std::vector<expr_node> const& operands)
+{
+    typedef std::map<std::string, attribute_bounds> bounds_map;
+    bounds_map bounds;
+
+    for (std::size_t i = 0; i != operands.size(); ++i) {
+        comparison_kind kind;
+        std::string name;
+        expr_node const* literal;
+
+        if (!comparison(operands[i], kind, name, literal))
+            continue;
+
+        mapnik::value_base const& v = boost::get<mapnik::value>(*literal).base();
+        attribute_bounds& b = bounds[name];
+
+        double n;
+
+        if (int const* iv = boost::get<int>(&v))
+            n = *iv;
+        else if (double const* d = boost::get<double>(&v))
+            n = *d;
+        else if (boost::get<UnicodeString>(&v)) {
+            // strings are told apart by how they are written out
+            if (kind == CMP_EQ)
+                b.equal(mapnik::to_expression_string(*literal));
+            else if (kind == CMP_NEQ)
+                b.excluded_strings.insert(mapnik::to_expression_string(*literal));
+            continue;
+        } else {
+            continue;
+        }
+
+        switch (kind) {
+            case CMP_EQ:  b.lower(n, false); b.upper(n, false); break;
+            case CMP_NEQ: b.excluded.push_back(n);              break;
+            case CMP_LT:  b.upper(n, true);                     break;
+            case CMP_LE:  b.upper(n, false);                    break;
+            case CMP_GT:  b.lower(n, true);                     break;
+            case CMP_GE:  b.lower(n, false);                    break;
+        }
+    }
+
+    for (bounds_map::const_iterator it = bounds.begin(); it != bounds.end(); ++it) {
+        if (!it->second.satisfiable())
+            return true;
+    }
+
+    return false;
+}
+
+// splits an already normalized node into the operands of Tag
+template<class Tag>
+void split(expr_node const& node, std::vector<expr_node>& operands)
+{
+    if (mapnik::binary_node<Tag> const* n = boost::get< mapnik::binary_node<Tag> >(&node)) {
+        split<Tag>(n->left, operands);
+        split<Tag>(n->right, operands);
+    } else {
+        operands.push_back(node);
+    }
+}
+
+template<class Tag>
+void collect(expr_node const& node, std::vector<expr_node>& operands)
+{
+    if (mapnik::binary_node<Tag> const* n = boost::get< mapnik::binary_node<Tag> >(&node)) {
+        collect<Tag>(n->left, operands);
+        collect<Tag>(n->right, operands);
+    } else {
+        split<Tag>(normalize_filter(node), operands);
+    }
+}
+
+// cheapest first, otherwise in the order they were written
+void order_by_cost(std::vector<expr_node>& operands)
+{
+    std::vector< std::pair<int, std::size_t> > order;
+
+    for (std::size_t i = 0; i != operands.size(); ++i)
+        order.push_back(std::make_pair(cost(operands[i]), i));
+
+    std::sort(order.begin(), order.end());
+
+    std::vector<expr_node> sorted;
+    for (std::size_t i = 0; i != order.size(); ++i)
+        sorted.push_back(operands[order[i].second]);
+
+    operands.swap(sorted);
+}
+
+// Flattens, dedupes and orders the operands of an and (Tag logical_and,
+// absorbing false) or an or (logical_or, absorbing true)
+template<class Tag>
+expr_node junction(expr_node const& node, bool absorbing)
+{
+    std::vector<expr_node> operands;
+    collect<Tag>(node, operands);
+
+    std::vector<expr_node> kept;
+    std::set<std::string> seen;
+
+    for (std::size_t i = 0; i != operands.size(); ++i) {
+        bool value;
+
+        if (constant(operands[i], value)) {
+            if (value == absorbing)
+                return constant_node(absorbing);
+            continue;
+        }
+
+        if (seen.insert(mapnik::to_expression_string(operands[i])).second)
+            kept.push_back(operands[i]);
+    }
+
+    if (!absorbing && contradictory(kept))
+        return constant_node(false);
+
+    if (kept.empty())
+        return constant_node(!absorbing);
+
+    order_by_cost(kept);
+
+    expr_node out = kept.front();
+    for (std::size_t i = 1; i != kept.size(); ++i)
+        append_operand<Tag>(out, kept[i]);
+
+    return out;
+}
+
+expr_node negation(expr_node const& node)
+{
+    bool value;
+
+    if (constant(node, value))
+        return constant_node(!value);
+
+    if (not_node const* n = boost::get<not_node>(&node))
+        return n->expr;
+
+    // a comparison stays under its not: mapnik's = and != are both false
+    // for a missing or null attribute, so not = matches features != does
+    // not
+    return not_node(node);
+}
+
+}
+
+expr_node normalize_filter(expr_node const& node)
+{
+    if (boost::get<and_node>(&node))
+        return junction<mapnik::tags::logical_and>(node, false);
+
+    if (boost::get<or_node>(&node))
+        return junction<mapnik::tags::logical_or>(node, true);
+
+    if (not_node const* n = boost::get<not_node>(&node))
+        return negation(normalize_filter(n->expr));
+
+    return node;
+}
+
+bool is_false_filter(expr_node const& node)
+{
+    bool value;
+    return constant(node, value) && !value;
+}
+
+}
@@ -0,0 +1,139 @@
+#include <property_table.hpp>
+
+#include <boost/assert.hpp>
+
+#include <utility/symbol_table.hpp>
+
+namespace carto {
+
+namespace spirit = boost::spirit;
+using spirit::utree;
+using spirit::utree_type;
+
+namespace {
+
+property const properties[] = {
+    { "polygon-fill",                    POLYGON_SYMBOLIZER,          PROP_POLYGON_FILL },
+    { "polygon-gamma",                   POLYGON_SYMBOLIZER,          PROP_POLYGON_GAMMA },
+    { "polygon-opacity",                 POLYGON_SYMBOLIZER,          PROP_POLYGON_OPACITY },
+
+    { "line-dasharray",                  LINE_SYMBOLIZER,             PROP_LINE_DASHARRAY },
+    { "line-color",                      LINE_SYMBOLIZER,             PROP_LINE_COLOR },
+    { "line-width",                      LINE_SYMBOLIZER,             PROP_LINE_WIDTH },
+    { "line-opacity",                    LINE_SYMBOLIZER,             PROP_LINE_OPACITY },
+    { "line-join",                       LINE_SYMBOLIZER,             PROP_LINE_JOIN },
+    { "line-cap",                        LINE_SYMBOLIZER,             PROP_LINE_CAP },
+    { "line-gamma",                      LINE_SYMBOLIZER,             PROP_LINE_GAMMA },
+    { "line-dash-offset",                LINE_SYMBOLIZER,             PROP_LINE_DASH_OFFSET },
+
+    { "marker-file",                     MARKERS_SYMBOLIZER,          PROP_MARKER_FILE },
+    { "marker-opacity",                  MARKERS_SYMBOLIZER,          PROP_MARKER_OPACITY },
+    { "marker-placement",                MARKERS_SYMBOLIZER,          PROP_MARKER_PLACEMENT },
+    { "marker-type",                     MARKERS_SYMBOLIZER,          PROP_MARKER_TYPE },
+    { "marker-width",                    MARKERS_SYMBOLIZER,          PROP_MARKER_WIDTH },
+    { "marker-height",                   MARKERS_SYMBOLIZER,          PROP_MARKER_HEIGHT },
+    { "marker-fill",                     MARKERS_SYMBOLIZER,          PROP_MARKER_FILL },
+    { "marker-allow-overlap",            MARKERS_SYMBOLIZER,          PROP_MARKER_ALLOW_OVERLAP },
+    { "marker-spacing",                  MARKERS_SYMBOLIZER,          PROP_MARKER_SPACING },
+    { "marker-max-error",                MARKERS_SYMBOLIZER,          PROP_MARKER_MAX_ERROR },
+    { "marker-transform",                MARKERS_SYMBOLIZER,          PROP_MARKER_TRANSFORM },
+    { "marker-line-color",               MARKERS_SYMBOLIZER,          PROP_MARKER_LINE_COLOR },
+    { "marker-line-width",               MARKERS_SYMBOLIZER,          PROP_MARKER_LINE_WIDTH },
+    { "marker-line-opacity",             MARKERS_SYMBOLIZER,          PROP_MARKER_LINE_OPACITY },
+
+    { "point-file",                      POINT_SYMBOLIZER,            PROP_POINT_FILE },
+    { "point-allow-overlap",             POINT_SYMBOLIZER,            PROP_POINT_ALLOW_OVERLAP },
+    { "point-ignore-placement",          POINT_SYMBOLIZER,            PROP_POINT_IGNORE_PLACEMENT },
+    { "point-opacity",                   POINT_SYMBOLIZER,            PROP_POINT_OPACITY },
+    { "point-placement",                 POINT_SYMBOLIZER,            PROP_POINT_PLACEMENT },
+    { "point-transform",                 POINT_SYMBOLIZER,            PROP_POINT_TRANSFORM },
+
+    { "line-pattern-file",               LINE_PATTERN_SYMBOLIZER,     PROP_LINE_PATTERN_FILE },
+
+    { "polygon-pattern-file",            POLYGON_PATTERN_SYMBOLIZER,  PROP_POLYGON_PATTERN_FILE },
+    { "polygon-pattern-alignment",       POLYGON_PATTERN_SYMBOLIZER,  PROP_POLYGON_PATTERN_ALIGNMENT },
+
+    { "raster-opacity",                  RASTER_SYMBOLIZER,           PROP_RASTER_OPACITY },
+    { "raster-mode",                     RASTER_SYMBOLIZER,           PROP_RASTER_MODE },
+    { "raster-scaling",                  RASTER_SYMBOLIZER,           PROP_RASTER_SCALING },
+
+    { "building-fill",                   BUILDING_SYMBOLIZER,         PROP_BUILDING_FILL },
+    { "building-fill-opacity",           BUILDING_SYMBOLIZER,         PROP_BUILDING_FILL_OPACITY },
+    { "building-height",                 BUILDING_SYMBOLIZER,         PROP_BUILDING_HEIGHT },
+
+    { "text-face-name",                  TEXT_SYMBOLIZER,             PROP_TEXT_FACE_NAME },
+    { "text-name",                       TEXT_SYMBOLIZER,             PROP_TEXT_NAME },
+    { "text-size",                       TEXT_SYMBOLIZER,             PROP_TEXT_SIZE },
+    { "text-ratio",                      TEXT_SYMBOLIZER,             PROP_TEXT_RATIO },
+    { "text-wrap-width",                 TEXT_SYMBOLIZER,             PROP_TEXT_WRAP_WIDTH },
+    { "text-spacing",                    TEXT_SYMBOLIZER,             PROP_TEXT_SPACING },
+    { "text-character-spacing",          TEXT_SYMBOLIZER,             PROP_TEXT_CHARACTER_SPACING },
+    { "text-line-spacing",               TEXT_SYMBOLIZER,             PROP_TEXT_LINE_SPACING },
+    { "text-label-position-tolerance",   TEXT_SYMBOLIZER,             PROP_TEXT_LABEL_POSITION_TOLERANCE },
+    { "text-max-char-angle-delta",       TEXT_SYMBOLIZER,             PROP_TEXT_MAX_CHAR_ANGLE_DELTA },
+    { "text-fill",                       TEXT_SYMBOLIZER,             PROP_TEXT_FILL },
+    { "text-opacity",                    TEXT_SYMBOLIZER,             PROP_TEXT_OPACITY },
+    { "text-halo-fill",                  TEXT_SYMBOLIZER,             PROP_TEXT_HALO_FILL },
+    { "text-halo-radius",                TEXT_SYMBOLIZER,             PROP_TEXT_HALO_RADIUS },
+    { "text-dx",                         TEXT_SYMBOLIZER,             PROP_TEXT_DX },
+    { "text-dy",                         TEXT_SYMBOLIZER,             PROP_TEXT_DY },
+    { "text-vertical-alignment",         TEXT_SYMBOLIZER,             PROP_TEXT_VERTICAL_ALIGNMENT },
+    { "text-avoid-edges",                TEXT_SYMBOLIZER,             PROP_TEXT_AVOID_EDGES },
+    { "text-min-distance",               TEXT_SYMBOLIZER,             PROP_TEXT_MIN_DISTANCE },
+    { "text-min-padding",                TEXT_SYMBOLIZER,             PROP_TEXT_MIN_PADDING },
+    { "text-allow-overlap",              TEXT_SYMBOLIZER,             PROP_TEXT_ALLOW_OVERLAP },
+    { "text-placement",                  TEXT_SYMBOLIZER,             PROP_TEXT_PLACEMENT },
+    { "text-placement-type",             TEXT_SYMBOLIZER,             PROP_TEXT_PLACEMENT_TYPE },
+    { "text-placements",                 TEXT_SYMBOLIZER,             PROP_TEXT_PLACEMENTS },
+    { "text-transform",                  TEXT_SYMBOLIZER,             PROP_TEXT_TRANSFORM },
+
+    { "shield-name",                     SHIELD_SYMBOLIZER,           PROP_SHIELD_NAME },
+    { "shield-face-name",                SHIELD_SYMBOLIZER,           PROP_SHIELD_FACE_NAME },
+    { "shield-size",                     SHIELD_SYMBOLIZER,           PROP_SHIELD_SIZE },
+    { "shield-spacing",                  SHIELD_SYMBOLIZER,           PROP_SHIELD_SPACING },
+    { "shield-character-spacing",        SHIELD_SYMBOLIZER,           PROP_SHIELD_CHARACTER_SPACING },
+    { "shield-line-spacing",             SHIELD_SYMBOLIZER,           PROP_SHIELD_LINE_SPACING },
+    { "shield-fill",                     SHIELD_SYMBOLIZER,           PROP_SHIELD_FILL },
+    { "shield-text-dx",                  SHIELD_SYMBOLIZER,           PROP_SHIELD_TEXT_DX },
+    { "shield-text-dy",                  SHIELD_SYMBOLIZER,           PROP_SHIELD_TEXT_DY },
+    { "shield-dx",                       SHIELD_SYMBOLIZER,           PROP_SHIELD_DX },
+    { "shield-dy",                       SHIELD_SYMBOLIZER,           PROP_SHIELD_DY },
+    { "shield-min-distance",             SHIELD_SYMBOLIZER,           PROP_SHIELD_MIN_DISTANCE },
+    { "shield-placement",                SHIELD_SYMBOLIZER,           PROP_SHIELD_PLACEMENT }
+};
+
+std::size_t const property_count = sizeof(properties) / sizeof(properties[0]);
+
+// names interned in table order, so a name's id is its index in properties
+struct property_index {
+    symbol_table names;
+
+    property_index()
+      : names()
+    {
+        for (std::size_t i = 0; i != property_count; ++i) {
+            symbol_id id = names.intern(std::string(properties[i].name));
+            BOOST_ASSERT(id == i);
+        }
+    }
+};
+
+}
+
+property const* find_property(utree const& name)
+{
+    static property_index const index;
+
+    if (name.which() != utree_type::symbol_type)
+        return 0;
+
+    spirit::utf8_symbol_range_type rng = name.get<spirit::utf8_symbol_range_type>();
+    
+    symbol_id id;
+    if (!index.names.find(rng.begin(), rng.end(), id))
+        return 0;
+
+    return &properties[id];
+}
+
+}
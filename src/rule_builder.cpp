@@ -0,0 +1,115 @@
+#include <rule_builder.hpp>
+
+#include <algorithm>
+
+#include <boost/assert.hpp>
+#include <boost/make_shared.hpp>
+
+namespace carto {
+
+rule_builder::symbolizer_set::symbolizer_set()
+  : rule()
+{
+    std::fill(slots, slots + symbolizer_count, -1);
+}
+
+rule_builder::symbolizer_set::symbolizer_set(symbolizer_set const& other)
+  : rule(other.rule, true)
+{
+    std::copy(other.slots, other.slots + symbolizer_count, slots);
+}
+
+rule_builder::rule_builder()
+  : syms(),
+    materialized(false)
+{
+    // start from whatever mapnik considers an unfiltered rule
+    mapnik::rule rule;
+
+    filter    = rule.get_filter();
+    min_scale = rule.get_min_scale();
+    max_scale = rule.get_max_scale();
+}
+
+mapnik::expression_ptr const& rule_builder::get_filter() const
+{
+    return filter;
+}
+
+void rule_builder::set_filter(mapnik::expression_ptr const& filter_)
+{
+    filter = filter_;
+}
+
+double rule_builder::get_min_scale() const
+{
+    return min_scale;
+}
+
+double rule_builder::get_max_scale() const
+{
+    return max_scale;
+}
+
+void rule_builder::set_min_scale(double scale)
+{
+    min_scale = scale;
+}
+
+void rule_builder::set_max_scale(double scale)
+{
+    max_scale = scale;
+}
+
+bool rule_builder::empty() const
+{
+    return !syms || syms->rule.get_symbolizers().empty();
+}
+
+void rule_builder::append(mapnik::symbolizer const& sym)
+{
+    symbolizer_set& set = writable();
+    int& slot = set.slots[sym.which()];
+
+    if (slot < 0)
+        slot = set.rule.get_symbolizers().size();
+
+    set.rule.append(sym);
+}
+
+void rule_builder::copy_symbolizers(rule_builder const& other)
+{
+    syms = other.syms;
+    materialized = other.materialized;
+}
+
+mapnik::rule rule_builder::materialize()
+{
+    BOOST_ASSERT(!empty());
+
+    // a copy of the builder still refers to the symbolizers, so the rule
+    // gets its own, otherwise they are handed over and copied on the next
+    // change
+    mapnik::rule rule(syms->rule, !syms.unique());
+    materialized = syms.unique();
+
+    rule.set_filter(filter);
+    rule.set_min_scale(min_scale);
+    rule.set_max_scale(max_scale);
+
+    return rule;
+}
+
+rule_builder::symbolizer_set& rule_builder::writable()
+{
+    if (!syms) {
+        syms = boost::make_shared<symbolizer_set>();
+    } else if (!syms.unique() || materialized) {
+        syms = boost::make_shared<symbolizer_set>(*syms);
+        materialized = false;
+    }
+
+    return *syms;
+}
+
+}
@@ -0,0 +1,102 @@
+#include <selector_index.hpp>
+
+#include <boost/algorithm/string.hpp>
+
+namespace carto {
+
+namespace al = boost::algorithm;
+
+selector_index::selectors selector_index::split(std::string const& style_name)
+{
+    std::string name = style_name;
+
+    // remove attachment from style name
+    std::size_t loc = name.find("::");
+    if (loc != std::string::npos)
+        al::erase_tail(name, name.length()-loc);
+
+    al::trim_if(name, al::is_any_of(". "));
+
+    selectors tokens;
+    al::split(tokens, name, al::is_any_of(". "));
+
+    return tokens;
+}
+
+void selector_index::insert(std::string const& style_name)
+{
+    std::size_t id = names_.size();
+
+    names_.push_back(style_name);
+    tokens_.push_back(split(style_name));
+
+    selectors const& tokens = tokens_.back();
+
+    for (std::size_t i = 0; i != tokens.size(); ++i) {
+        std::vector<std::size_t>& ids = postings_[tokens[i]];
+
+        // a token repeated within one name is listed once
+        if (ids.empty() || ids.back() != id)
+            ids.push_back(id);
+    }
+}
+
+// whether the layer tokens are a subsequence of the style tokens, where
+// one style token may match several equal layer tokens in a row
+bool selector_index::matches(selectors const& layer, selectors const& style)
+{
+    typedef selectors::const_iterator iter;
+
+    iter lselect_it  = layer.begin(),
+         lselect_end = layer.end(),
+         sselect_it  = style.begin(),
+         sselect_end = style.end();
+
+    for (; lselect_it != lselect_end; ++lselect_it) {
+        while (sselect_it != sselect_end && *lselect_it != *sselect_it)
+            ++sselect_it;
+
+        if (sselect_it == sselect_end) break;
+    }
+
+    return lselect_it == lselect_end && sselect_it != sselect_end;
+}
+
+void selector_index::match(selectors const& layer, std::vector<std::string>& styles) const
+{
+    // a layer without selectors takes every style with a name
+    if (layer.empty()) {
+        for (std::size_t id = 0; id != names_.size(); ++id) {
+            if (matches(layer, tokens_[id]))
+                styles.push_back(names_[id]);
+        }
+        return;
+    }
+
+    std::vector<std::size_t> const* rarest = 0;
+
+    for (std::size_t i = 0; i != layer.size(); ++i) {
+        posting_map::const_iterator it = postings_.find(layer[i]);
+
+        // no style has this token, so none has all of them
+        if (it == postings_.end())
+            return;
+
+        if (!rarest || it->second.size() < rarest->size())
+            rarest = &it->second;
+    }
+
+    typedef std::vector<std::size_t>::const_iterator iter;
+
+    for (iter it = rarest->begin(); it != rarest->end(); ++it) {
+        if (matches(layer, tokens_[*it]))
+            styles.push_back(names_[*it]);
+    }
+}
+
+std::size_t selector_index::size() const
+{
+    return names_.size();
+}
+
+}
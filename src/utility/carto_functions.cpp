@@ -6,6 +6,7 @@
 
 #include <utility/utree.hpp>
 #include <utility/round.hpp>
+#include <utility/color.hpp>
 
 
 namespace carto {
@@ -19,15 +20,11 @@ inline double clamp(double val) {
 
 hsl::hsl(utree const& rgb)
 {
-    BOOST_ASSERT(rgb.size() == 4);
+    mapnik::color color = as<mapnik::color>(rgb);
 
-    typedef utree::const_iterator iter;
-    iter it  = rgb.begin(),
-         end = rgb.end();
-
-    double r = as<double>(*it) / 255; it++;
-    double g = as<double>(*it) / 255; it++;
-    double b = as<double>(*it) / 255; it++;
+    double r = color.red()   / 255.0;
+    double g = color.green() / 255.0;
+    double b = color.blue()  / 255.0;
     
     double max = std::max(r,std::max(g,b)),
            min = std::min(r,std::min(g,b));
@@ -35,7 +32,7 @@ hsl::hsl(utree const& rgb)
     h = (max + min) / 2;
     s = (max + min) / 2;
     l = (max + min) / 2;
-    a = (it != end) ? as<double>(*it) : 255;
+    a = color.alpha();
 
     double d = max - min;
 
@@ -71,13 +68,10 @@ utree hsl::to_rgb()
     double m2 = (l <= 0.5) ? l * (s + 1) : l + s - l * s;
     double m1 = l * 2 - m2;
     
-    utree ut;
-    ut.push_back( round(hue(h + 1.0/3,m1,m2) * 255) );
-    ut.push_back( round(hue(h        ,m1,m2) * 255) );
-    ut.push_back( round(hue(h - 1.0/3,m1,m2) * 255) );
-    ut.push_back( round(a) );
-
-    return ut;
+    return make_color( round(hue(h + 1.0/3,m1,m2) * 255),
+                       round(hue(h        ,m1,m2) * 255),
+                       round(hue(h - 1.0/3,m1,m2) * 255),
+                       round(a) );
 }
 
 utree test(utree const& rgb)
@@ -105,10 +99,7 @@ utree lightness(utree const& rgb)
 
 utree alpha(utree const& rgb)
 {
-    BOOST_ASSERT(rgb.size() == 3 || rgb.size() == 4);
-    utree::const_iterator it = ++(++(++rgb.begin()));
-    
-    return *it;
+    return utree( int(as<mapnik::color>(rgb).alpha()) );
 }
 
 
@@ -197,13 +188,10 @@ utree mix(utree const& col1, utree const& col2, utree const& weight)
     double w1 = (((w * a == -1) ? w : (w + a) / (1 + w * a)) + 1) / 2.0;
     double w2 = 1 - w1;
     
-    utree ut;
-    ut.push_back(rgb1.red()   * w1 + rgb2.red()   * w2     );
-    ut.push_back(rgb1.green() * w1 + rgb2.green() * w2     );
-    ut.push_back(rgb1.blue()  * w1 + rgb2.blue()  * w2     );
-    ut.push_back(rgb1.alpha() * p  + rgb2.alpha() * (1 - p));
-    
-    return ut;
+    return make_color( rgb1.red()   * w1 + rgb2.red()   * w2,
+                       rgb1.green() * w1 + rgb2.green() * w2,
+                       rgb1.blue()  * w1 + rgb2.blue()  * w2,
+                       rgb1.alpha() * p  + rgb2.alpha() * (1 - p) );
 }
 
 
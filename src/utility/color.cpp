@@ -2,18 +2,33 @@
 
 namespace carto {
 
+namespace spirit = boost::spirit;
 using boost::spirit::utree;
 
-utree::list_type color_conv_impl::operator() (mapnik::color color) const
+utree make_color(mapnik::color const& color)
 {
-    utree::list_type u;
-    u.push_back(color.red());
-    u.push_back(color.green());
-    u.push_back(color.blue());
-    u.push_back(color.alpha());
+    char rgba[4];
+    rgba[0] = (char) color.red();
+    rgba[1] = (char) color.green();
+    rgba[2] = (char) color.blue();
+    rgba[3] = (char) color.alpha();
     
-    return u;
+    return utree(spirit::binary_string_type(rgba, 4));
 }
 
+utree make_color(double r, double g, double b, double a)
+{
+    return make_color(mapnik::color(int(r), int(g), int(b), int(a)));
+}
+
+bool is_color(utree const& ut)
+{
+    return ut.which() == spirit::utree_type::binary_type;
 }
 
+utree color_conv_impl::operator() (mapnik::color color) const
+{
+    return make_color(color);
+}
+
+}
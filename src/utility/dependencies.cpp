@@ -0,0 +1,12 @@
+#include <utility/dependencies.hpp>
+
+namespace carto {
+
+void dependency_set::clear()
+{
+    defines.clear();
+    uses.clear();
+    styles.clear();
+}
+
+}
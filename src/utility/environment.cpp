@@ -1,51 +1,103 @@
 #include <utility/environment.hpp>
+#include <utility/profile.hpp>
 
 #include <boost/spirit/include/support_utree.hpp>
-#include <boost/unordered_map.hpp>
 
 namespace carto {
 
 namespace spirit = boost::spirit;
 using spirit::utree;
 
-environment::environment(void): parent(), definitions() { }
+environment::environment(void)
+  : bindings(), 
+    depth(0),
+    deps(),
+    recorded() { }
 
 environment::environment(environment const& parent_)
-  : parent(&parent_), 
-    definitions() { }
+  : bindings(parent_.bindings), 
+    depth(parent_.depth + 1),
+    deps(parent_.deps),
+    recorded(parent_.recorded) { }
 
-utree environment::lookup (std::string const& name) const {
-    map_type::const_iterator it = definitions.find(name);
+symbol_id environment::intern (std::string const& name) const {
+    return intern_symbol(name);
+}
+
+symbol_id environment::intern (utree const& name) const {
+    symbol_id id;
+    
+    if (annotations_type::symbol(name, id))
+        return id;
+    
+    return intern_symbol(name);
+}
 
-    if (it == definitions.end()) {
-        if (parent)
-            return (parent->lookup(name));
+std::string const& environment::name (symbol_id id) const {
+    return symbol_name(id);
+}
 
-        return utree::nil_type();
+void environment::record_use (symbol_id id) const {
+    std::vector<bool>& seen = *recorded;
+    
+    if (id >= seen.size())
+        seen.resize(id + 1, false);
+    
+    if (!seen[id]) {
+        seen[id] = true;
+        deps->uses.insert(name(id));
     }
+}
 
-    return it->second; 
+utree environment::lookup (symbol_id id) const {
+    profiler::count(profiler::variable_lookups);
+    
+    if (deps)
+        record_use(id);
+    
+    binding const* b = bindings.find(id);
+    
+    return b ? b->value : utree(utree::nil_type());
 }
 
-void environment::define (std::string const& name, utree const& val) {
-    //BOOST_ASSERT(!definitions.count(name));
-    definitions[name] = val;
+utree environment::lookup (std::string const& name) const {
+    return lookup(intern(name));
 }
 
-bool environment::defined (std::string const& name) const {
-    if (!definitions.count(name)) {
-        if (parent)
-            return parent->defined(name);
+source_location environment::location (symbol_id id) const {
+    binding const* b = bindings.find(id);
+    
+    return b ? b->loc : source_location();
+}
 
-        return false;
-    }
+void environment::define (symbol_id id, utree const& val, source_location const& loc) {
+    profiler::count(profiler::variables_defined);
+    
+    bindings = bindings.insert(id, binding(val, depth, loc));
+    
+    // only top level definitions are visible to other stylesheets
+    if (deps && depth == 0)
+        deps->defines.insert(name(id));
+}
+
+void environment::define (std::string const& name, utree const& val, source_location const& loc) {
+    define(intern(name), val, loc);
+}
 
-    return true; 
+bool environment::defined (std::string const& name) const {
+    return bindings.find(intern(name)) != 0;
 }
 
 bool environment::locally_defined (std::string const& name) const {
-    return definitions.count(name); 
-} 
+    binding const* b = bindings.find(intern(name));
+    
+    return b && b->depth == depth;
+}
+
+void environment::set_dependencies (dependency_set* deps_) {
+    deps = deps_;
+    recorded.reset(deps ? new std::vector<bool>() : 0);
+}
 
 style_env::style_env() 
   : vars(),
@@ -60,4 +112,3 @@ style_env::style_env(style_env const& env)
     mixins(env.mixins) { }
 
 }
-
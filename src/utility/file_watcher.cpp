@@ -0,0 +1,220 @@
+#include <utility/file_watcher.hpp>
+#include <utility/carto_error.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <set>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <unistd.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <time.h>
+#include <sys/inotify.h>
+#endif
+
+namespace carto {
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+unsigned const settle_ms = 50;
+
+std::time_t modified(std::string const& filename)
+{
+    boost::system::error_code ec;
+    std::time_t t = fs::last_write_time(fs::path(filename), ec);
+    return ec ? 0 : t;
+}
+
+// The canonical form of the file's directory, so symlinks and relative
+// components name a file the same way the events do. The file itself is
+// not resolved, editors may replace it while it is watched.
+std::string canonical_path(std::string const& filename)
+{
+    fs::path abs = fs::absolute(fs::path(filename));
+    
+    boost::system::error_code ec;
+    fs::path dir = fs::canonical(abs.parent_path(), ec);
+    
+    return ec ? abs.string() : (dir / abs.filename()).string();
+}
+
+#ifdef __linux__
+
+long monotonic_ms()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return long(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+#endif
+
+}
+
+file_watcher::file_watcher()
+  : fd_(-1)
+{
+#ifdef __linux__
+    fd_ = ::inotify_init();
+    
+    if (fd_ == -1)
+        throw carto_error(std::string("Cannot watch input files (")+std::strerror(errno)+")");
+#endif
+}
+
+file_watcher::~file_watcher()
+{
+    if (fd_ != -1)
+        ::close(fd_);
+}
+
+void file_watcher::add(std::string const& filename)
+{
+    std::string abs = canonical_path(filename);
+    
+    if (files_.count(abs))
+        return;
+    
+    files_[abs] = modified(abs);
+    
+#ifdef __linux__
+    std::string dir = fs::path(abs).parent_path().string();
+    
+    // adding a directory twice hands back the same descriptor
+    int wd = ::inotify_add_watch(fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    
+    if (wd == -1)
+        throw carto_error(std::string("Cannot watch directory: ")+dir+" ("+std::strerror(errno)+")");
+    
+    dirs_[wd] = dir;
+#endif
+}
+
+void file_watcher::clear()
+{
+#ifdef __linux__
+    typedef std::map<int, std::string>::const_iterator iter;
+    for (iter it = dirs_.begin(); it != dirs_.end(); ++it)
+        ::inotify_rm_watch(fd_, it->first);
+#endif
+    
+    dirs_.clear();
+    files_.clear();
+}
+
+#ifdef __linux__
+
+std::vector<std::string> file_watcher::wait()
+{
+    std::set<std::string> changed;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    
+    // only events on watched files put the end of the burst off, other
+    // files in their directories may be written all the time
+    long settled = 0;
+    
+    while (true) {
+        pollfd pfd;
+        pfd.fd = fd_;
+        pfd.events = POLLIN;
+        
+        // block until the first relevant event, then drain until things settle
+        int timeout = -1;
+        
+        if (!changed.empty()) {
+            long left = settled - monotonic_ms();
+            
+            if (left <= 0)
+                break;
+            
+            timeout = int(left);
+        }
+        
+        int ready = ::poll(&pfd, 1, timeout);
+        
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            throw carto_error(std::string("Error while watching input files (")+std::strerror(errno)+")");
+        }
+        
+        if (ready == 0)
+            break;
+        
+        ssize_t n = ::read(fd_, buf, sizeof(buf));
+        
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            throw carto_error(std::string("Error while watching input files (")+std::strerror(errno)+")");
+        }
+        
+        for (char* p = buf; p < buf + n; ) {
+            inotify_event const* ev = reinterpret_cast<inotify_event const*>(p);
+            p += sizeof(inotify_event) + ev->len;
+            
+            // events were dropped, any of the files may have changed
+            if (ev->mask & IN_Q_OVERFLOW) {
+                typedef std::map<std::string, std::time_t>::const_iterator iter;
+                for (iter it = files_.begin(); it != files_.end(); ++it)
+                    changed.insert(it->first);
+                
+                settled = monotonic_ms() + settle_ms;
+                continue;
+            }
+            
+            std::map<int, std::string>::const_iterator dir = dirs_.find(ev->wd);
+            
+            if (dir == dirs_.end() || ev->len == 0)
+                continue;
+            
+            std::string filename = (fs::path(dir->second) / ev->name).string();
+            
+            if (files_.count(filename)) {
+                changed.insert(filename);
+                settled = monotonic_ms() + settle_ms;
+            }
+        }
+    }
+    
+    for (std::set<std::string>::const_iterator it = changed.begin(); it != changed.end(); ++it)
+        files_[*it] = modified(*it);
+    
+    return std::vector<std::string>(changed.begin(), changed.end());
+}
+
+#else
+
+std::vector<std::string> file_watcher::wait()
+{
+    unsigned const poll_ms = 250;
+    
+    std::vector<std::string> changed;
+    
+    while (changed.empty()) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(poll_ms));
+        
+        typedef std::map<std::string, std::time_t>::iterator iter;
+        for (iter it = files_.begin(); it != files_.end(); ++it) {
+            std::time_t t = modified(it->first);
+            
+            if (t != it->second) {
+                it->second = t;
+                changed.push_back(it->first);
+            }
+        }
+    }
+    
+    // give the editor a moment to finish writing
+    boost::this_thread::sleep(boost::posix_time::milliseconds(settle_ms));
+    
+    return changed;
+}
+
+#endif
+
+}
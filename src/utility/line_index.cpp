@@ -0,0 +1,105 @@
+#include <utility/line_index.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace carto {
+
+namespace {
+
+typedef boost::uint64_t word;
+
+word const ones = ~word(0) / 255;
+
+// whether any byte of w is below 14, i.e. might be a tab or a line break;
+// exact for the word as a whole, and most words of a stylesheet have none
+inline bool has_control(word w)
+{
+    return ((w - ones * ('\r' + 1)) & ~w & (ones * 0x80)) != 0;
+}
+
+inline std::size_t count(std::vector<boost::uint32_t> const& offsets,
+                         boost::uint32_t first, boost::uint32_t last)
+{
+    return std::lower_bound(offsets.begin(), offsets.end(), last)
+         - std::lower_bound(offsets.begin(), offsets.end(), first);
+}
+
+}
+
+line_index::line_index()
+  : starts_(1, 0),
+    tabs_(),
+    silent_() { }
+
+line_index::line_index(char const* first, char const* last)
+  : starts_(),
+    tabs_(),
+    silent_()
+{
+    scan(first, last);
+}
+
+void line_index::scan(char const* first, char const* last)
+{
+    starts_.push_back(0);
+
+    char const* it = first;
+    char prev = 0;
+
+    while (it != last) {
+        std::size_t n = std::min<std::size_t>(last - it, sizeof(word));
+
+        if (n == sizeof(word)) {
+            word w;
+            std::memcpy(&w, it, sizeof(word));
+
+            if (!has_control(w)) {
+                it += sizeof(word);
+                prev = 0;
+                continue;
+            }
+        }
+
+        for (char const* end = it + n; it != end; ++it) {
+            boost::uint32_t offset = it - first;
+
+            switch (*it) {
+                case '\r':
+                case '\n':
+                    // the second half of a pair only ends a line by itself
+                    if (prev == (*it == '\r' ? '\n' : '\r'))
+                        silent_.push_back(offset);
+                    else
+                        starts_.push_back(offset + 1);
+                    break;
+                case '\t':
+                    tabs_.push_back(offset);
+                    break;
+            }
+
+            prev = *it;
+        }
+    }
+}
+
+int line_index::line(boost::uint32_t offset) const
+{
+    return std::upper_bound(starts_.begin(), starts_.end(), offset) - starts_.begin();
+}
+
+int line_index::column(boost::uint32_t offset) const
+{
+    boost::uint32_t start = starts_[line(offset) - 1];
+
+    return offset - start
+         + count(tabs_, start, offset) * (tab_length - 1)
+         - count(silent_, start, offset);
+}
+
+std::size_t line_index::lines() const
+{
+    return starts_.size();
+}
+
+}
@@ -0,0 +1,102 @@
+#include <utility/mapped_file.hpp>
+#include <utility/carto_error.hpp>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace carto {
+
+mapped_file::mapped_file(std::string const& filename)
+  : data_(0),
+    size_(0),
+    mapped_(false),
+    buffer_()
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+
+    if (fd == -1)
+        throw carto_error(std::string("Cannot open input file: ")+filename);
+
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* p = ::mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (p != MAP_FAILED) {
+            ::madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+            data_   = static_cast<char const*>(p);
+            size_   = st.st_size;
+            mapped_ = true;
+        }
+    }
+
+    if (!mapped_)
+        read_all(fd, filename);
+
+    ::close(fd);
+}
+
+mapped_file::~mapped_file()
+{
+    if (mapped_)
+        ::munmap(const_cast<char*>(data_), size_);
+}
+
+void mapped_file::read_all(int fd, std::string const& filename)
+{
+    char buf[65536];
+
+    for (;;) {
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+
+        if (n == 0)
+            break;
+
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+
+            // close may set errno itself
+            int error = errno;
+            ::close(fd);
+            throw carto_error(std::string("Cannot read input file: ")+filename+" ("+std::strerror(error)+")");
+        }
+
+        buffer_.append(buf, n);
+    }
+
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+}
+
+mapped_file::const_iterator mapped_file::begin() const
+{
+    return data_;
+}
+
+mapped_file::const_iterator mapped_file::end() const
+{
+    return data_ + size_;
+}
+
+std::size_t mapped_file::size() const
+{
+    return size_;
+}
+
+mapped_file::range_type mapped_file::range() const
+{
+    return range_type(begin(), end());
+}
+
+bool mapped_file::is_mapped() const
+{
+    return mapped_;
+}
+
+}
@@ -0,0 +1,191 @@
+#include <utility/profile.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace carto {
+
+namespace {
+
+struct phase_time {
+    std::string phase;
+    std::string input;
+    double seconds;
+    std::size_t runs;
+};
+
+struct profile_state {
+    bool enabled;
+    std::vector<phase_time> phases;
+    std::size_t counters[profiler::counter_count];
+    boost::mutex mutex;
+
+    profile_state()
+      : enabled(false),
+        phases()
+    {
+        std::fill(counters, counters + profiler::counter_count, 0);
+    }
+};
+
+profile_state& state()
+{
+    static profile_state s;
+    return s;
+}
+
+char const* const counter_names[profiler::counter_count] = {
+    "annotated_nodes",
+    "variables_defined",
+    "variable_lookups",
+    "filters_generated",
+    "rules_emitted",
+    "symbolizers_created",
+    "expressions_parsed"
+};
+
+std::string json_string(std::string const& str)
+{
+    std::ostringstream out;
+    out << '"';
+
+    for (std::size_t i = 0; i != str.size(); ++i) {
+        unsigned char c = str[i];
+
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        else
+            out << c;
+    }
+
+    out << '"';
+    return out.str();
+}
+
+}
+
+void profiler::enable()
+{
+    state().enabled = true;
+}
+
+bool profiler::enabled()
+{
+    return state().enabled;
+}
+
+void profiler::count(counter c, std::size_t n)
+{
+    profile_state& s = state();
+
+    if (!s.enabled)
+        return;
+
+    boost::mutex::scoped_lock lock(s.mutex);
+    s.counters[c] += n;
+}
+
+void profiler::record(std::string const& phase, std::string const& input, double seconds)
+{
+    profile_state& s = state();
+
+    if (!s.enabled)
+        return;
+
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    typedef std::vector<phase_time>::iterator iter;
+
+    for (iter it = s.phases.begin(); it != s.phases.end(); ++it) {
+        if (it->phase == phase && it->input == input) {
+            it->seconds += seconds;
+            ++it->runs;
+            return;
+        }
+    }
+
+    phase_time t;
+    t.phase = phase;
+    t.input = input;
+    t.seconds = seconds;
+    t.runs = 1;
+
+    s.phases.push_back(t);
+}
+
+void profiler::write_json(std::ostream& out)
+{
+    profile_state& s = state();
+    boost::mutex::scoped_lock lock(s.mutex);
+
+    typedef std::vector<phase_time>::const_iterator iter;
+
+    // totals per phase, in the order the phases first finished
+    std::vector< std::pair<std::string, double> > totals;
+
+    for (iter it = s.phases.begin(); it != s.phases.end(); ++it) {
+        std::size_t i = 0;
+
+        while (i != totals.size() && totals[i].first != it->phase)
+            ++i;
+
+        if (i == totals.size())
+            totals.push_back(std::make_pair(it->phase, 0.0));
+
+        totals[i].second += it->seconds;
+    }
+
+    out << "{\n  \"phases\": [";
+
+    for (iter it = s.phases.begin(); it != s.phases.end(); ++it) {
+        out << (it == s.phases.begin() ? "\n" : ",\n")
+            << "    {\"phase\": " << json_string(it->phase)
+            << ", \"input\": " << json_string(it->input)
+            << ", \"seconds\": " << it->seconds
+            << ", \"runs\": " << it->runs << "}";
+    }
+
+    out << "\n  ],\n  \"totals\": {";
+
+    for (std::size_t i = 0; i != totals.size(); ++i) {
+        out << (i == 0 ? "\n" : ",\n")
+            << "    " << json_string(totals[i].first) << ": " << totals[i].second;
+    }
+
+    out << "\n  },\n  \"counters\": {";
+
+    for (std::size_t i = 0; i != counter_count; ++i) {
+        out << (i == 0 ? "\n" : ",\n")
+            << "    \"" << counter_names[i] << "\": " << s.counters[i];
+    }
+
+    out << "\n  }\n}\n";
+}
+
+profiler::timer::timer(char const* phase_, std::string const& input_)
+  : phase(phase_),
+    input(input_),
+    start()
+{
+    if (enabled())
+        start = boost::posix_time::microsec_clock::universal_time();
+}
+
+profiler::timer::~timer()
+{
+    if (!enabled() || start.is_not_a_date_time())
+        return;
+
+    boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::universal_time() - start;
+    record(phase, input, elapsed.total_microseconds() / 1e6);
+}
+
+}
@@ -9,29 +9,47 @@
 #include <sstream>
 
 #include <utility/source_location.hpp>
+#include <utility/line_index.hpp>
 
  
 namespace carto {
+
+boost::uint32_t const source_location::npos;
+ 
+source_location::source_location (boost::uint32_t o)
+  : offset(o),
+    lines()
+{ }
  
-source_location::source_location (int l, int c)
-  : line(l),
-    column(c)
+source_location::source_location (boost::uint32_t o, boost::shared_ptr<line_index const> const& l)
+  : offset(o),
+    lines(l)
 { }
  
 source_location::source_location ()
-  : line(-1),
-    column(-1)
+  : offset(npos),
+    lines()
 { }
  
-bool source_location::valid() {
-    return (line != -1) && (column != -1);
+bool source_location::valid() const {
+    return offset != npos;
+}
+ 
+int source_location::line() const {
+    return (valid() && lines) ? lines->line(offset) : -1;
+}
+ 
+int source_location::column() const {
+    return (valid() && lines) ? lines->column(offset) : -1;
 }
  
-std::string source_location::get_string() {
+std::string source_location::get_string() const {
     std::stringstream s;
     
-    if (valid())
-        s << "Line: " << line << " Col: " << column;
+    if (valid() && lines)
+        s << "Line: " << line() << " Col: " << column();
+    else if (valid())
+        s << "Offset: " << offset;
     else 
         s << "Unknown Position";
  
@@ -39,7 +57,7 @@ std::string source_location::get_string() {
 }
  
 bool source_location::operator==(source_location const& other) const {
-    return other.line == line && other.column == column;
+    return other.offset == offset;
 }
  
 }
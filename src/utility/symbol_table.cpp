@@ -0,0 +1,154 @@
+#include <utility/symbol_table.hpp>
+
+#include <cstring>
+
+#include <boost/assert.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace carto {
+
+using boost::spirit::utree;
+using boost::spirit::utree_type;
+
+symbol_id const symbol_table::empty;
+
+namespace {
+
+symbol_table shared_table;
+boost::mutex shared_mutex;
+
+}
+
+symbol_table::symbol_table()
+  : names_(),
+    slots_(64, empty) { }
+
+std::size_t symbol_table::hash(char const* begin, char const* end)
+{
+    std::size_t h = 2166136261u;
+    
+    for (; begin != end; ++begin) {
+        h ^= (unsigned char) *begin;
+        h *= 16777619u;
+    }
+    
+    return h;
+}
+
+symbol_id symbol_table::intern(char const* begin, char const* end)
+{
+    std::size_t n    = end - begin,
+                mask = slots_.size() - 1,
+                i    = hash(begin, end) & mask;
+    
+    for (; slots_[i] != empty; i = (i + 1) & mask) {
+        std::string const& candidate = names_[slots_[i]];
+        
+        if (candidate.size() == n && std::memcmp(candidate.data(), begin, n) == 0)
+            return slots_[i];
+    }
+    
+    symbol_id id = names_.size();
+    names_.push_back(std::string(begin, end));
+    slots_[i] = id;
+    
+    // keep the load factor under one half
+    if (names_.size() * 2 > slots_.size())
+        grow();
+    
+    return id;
+}
+
+bool symbol_table::find(char const* begin, char const* end, symbol_id& id) const
+{
+    std::size_t n    = end - begin,
+                mask = slots_.size() - 1,
+                i    = hash(begin, end) & mask;
+    
+    for (; slots_[i] != empty; i = (i + 1) & mask) {
+        std::string const& candidate = names_[slots_[i]];
+        
+        if (candidate.size() == n && std::memcmp(candidate.data(), begin, n) == 0) {
+            id = slots_[i];
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+symbol_id symbol_table::intern(std::string const& name)
+{
+    return intern(name.data(), name.data() + name.size());
+}
+
+symbol_id symbol_table::intern(utree const& name)
+{
+    switch (name.which()) {
+        case utree_type::symbol_type:
+        {
+            boost::spirit::utf8_symbol_range_type rng = name.get<boost::spirit::utf8_symbol_range_type>();
+            return intern(rng.begin(), rng.end());
+        }
+        case utree_type::string_type:
+        {
+            boost::spirit::utf8_string_range_type rng = name.get<boost::spirit::utf8_string_range_type>();
+            return intern(rng.begin(), rng.end());
+        }
+        case utree_type::list_type:
+            BOOST_ASSERT(name.size() == 1);
+            return intern(name.front());
+        default:
+            BOOST_ASSERT(false);
+            return intern(std::string());
+    }
+}
+
+std::string const& symbol_table::name(symbol_id id) const
+{
+    BOOST_ASSERT(id < names_.size());
+    return names_[id];
+}
+
+std::size_t symbol_table::size() const
+{
+    return names_.size();
+}
+
+void symbol_table::grow()
+{
+    std::vector<symbol_id> slots(slots_.size() * 2, empty);
+    std::size_t mask = slots.size() - 1;
+    
+    for (symbol_id id = 0; id != names_.size(); ++id) {
+        std::string const& name = names_[id];
+        std::size_t i = hash(name.data(), name.data() + name.size()) & mask;
+        
+        while (slots[i] != empty)
+            i = (i + 1) & mask;
+        
+        slots[i] = id;
+    }
+    
+    slots_.swap(slots);
+}
+
+symbol_id intern_symbol(std::string const& name)
+{
+    boost::mutex::scoped_lock lock(shared_mutex);
+    return shared_table.intern(name);
+}
+
+symbol_id intern_symbol(utree const& name)
+{
+    boost::mutex::scoped_lock lock(shared_mutex);
+    return shared_table.intern(name);
+}
+
+std::string const& symbol_name(symbol_id id)
+{
+    boost::mutex::scoped_lock lock(shared_mutex);
+    return shared_table.name(id);
+}
+
+}
@@ -62,14 +62,16 @@ std::string as<std::string>(utree const& ut)
 template<>
 mapnik::color as<mapnik::color>(utree const& ut) 
 {    
-    BOOST_ASSERT(ut.size()==4);
+    spirit::binary_range_type rgba = ut.get<spirit::binary_range_type>();
     
-    utree::const_iterator it = ut.begin();
+    BOOST_ASSERT(rgba.end() - rgba.begin() == 4);
     
-    int r = as<int>(*it++),
-        g = as<int>(*it++),
-        b = as<int>(*it++),
-        a = as<int>(*it++);
+    spirit::binary_range_type::const_iterator it = rgba.begin();
+    
+    unsigned char r = *it++,
+                  g = *it++,
+                  b = *it++,
+                  a = *it++;
     
     return mapnik::color(r,g,b,a);
 }
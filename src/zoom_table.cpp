@@ -0,0 +1,109 @@
+#include <generate/zoom_table.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include <utility/carto_error.hpp>
+
+namespace carto {
+
+namespace {
+
+double const legacy_bounds[] = { 1000000000, 500000000, 200000000, 100000000,
+                                   50000000,  25000000,  12500000,   6500000,
+                                    3000000,   1500000,    750000,    400000,
+                                     200000,    100000,     50000,     25000,
+                                      12500,      5000,      2500,      1500,
+                                        750,       500,       250,       100,
+                                          0 };
+
+// spherical mercator zoom 0 on a 256 pixel tile, at 0.28 mm per pixel
+double const zoom0_scale = 559082264.028717;
+
+void check_max_zoom(unsigned max_zoom)
+{
+    if (max_zoom > zoom_table::max_levels) {
+        std::ostringstream out;
+        out << "Max zoom must be at most " << int(zoom_table::max_levels);
+        throw carto_error(out.str());
+    }
+}
+
+}
+
+zoom_table::zoom_table()
+  : bounds_(legacy_bounds, legacy_bounds + sizeof(legacy_bounds) / sizeof(double)),
+    key_() { }
+
+zoom_table::zoom_table(unsigned max_zoom)
+  : bounds_(),
+    key_()
+{
+    check_max_zoom(max_zoom);
+
+    unsigned const legacy_zoom = sizeof(legacy_bounds) / sizeof(double) - 2;
+
+    bounds_.assign(legacy_bounds, legacy_bounds + std::min(max_zoom, legacy_zoom) + 1);
+
+    for (unsigned z = legacy_zoom + 1; z <= max_zoom; ++z)
+        bounds_.push_back(bounds_.back() / 2);
+    bounds_.push_back(0);
+
+    // the default table keeps the default key
+    if (max_zoom != legacy_zoom) {
+        std::ostringstream key;
+        key << "zoom legacy " << max_zoom;
+        key_ = key.str();
+    }
+}
+
+zoom_table::zoom_table(unsigned tile_size, double scale_factor, unsigned max_zoom)
+  : bounds_(),
+    key_()
+{
+    if (tile_size == 0)
+        throw carto_error("Tile size must be positive");
+    if (!(scale_factor > 0))
+        throw carto_error("Scale factor must be positive");
+    check_max_zoom(max_zoom);
+
+    // mapnik multiplies the scale denominator by the scale factor it
+    // renders with
+    double const scale = zoom0_scale * 256.0 / tile_size * scale_factor;
+
+    for (unsigned z = 0; z <= max_zoom; ++z)
+        bounds_.push_back(scale / std::pow(2.0, double(z)) * std::sqrt(2.0));
+    bounds_.push_back(0);
+
+    std::ostringstream key;
+    key << "zoom " << tile_size << " " << scale_factor << " " << max_zoom;
+    key_ = key.str();
+}
+
+int zoom_table::max_zoom() const
+{
+    return int(bounds_.size()) - 2;
+}
+
+bool zoom_table::scale_range(int first, int last, double& min_scale, double& max_scale) const
+{
+    if (first < 0)
+        first = 0;
+    if (last > max_zoom())
+        last = max_zoom();
+
+    if (first > last)
+        return false;
+
+    max_scale = bounds_[first];
+    min_scale = bounds_[last + 1];
+    return true;
+}
+
+std::string const& zoom_table::key() const
+{
+    return key_;
+}
+
+}
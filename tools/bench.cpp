@@ -0,0 +1,507 @@
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <sys/resource.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <mapnik/map.hpp>
+#include <mapnik/save_map.hpp>
+
+#include <mss_parser.hpp>
+#include <fold_constants.hpp>
+#include <generate/generate_filter.hpp>
+#include <parse/carto_grammar.hpp>
+#include <parse/node_types.hpp>
+#include <parse/parse_tree.hpp>
+#include <utility/environment.hpp>
+#include <utility/line_index.hpp>
+#include <utility/mapped_file.hpp>
+
+namespace {
+
+// Allocations made by the whole process, counted by the operator new
+// below. The phases all run on the main thread, so plain counters do.
+std::size_t allocations = 0;
+std::size_t allocated_bytes = 0;
+
+enum phase {
+    phase_read,
+    phase_parse,
+    phase_annotate,
+    phase_resolve,
+    phase_filters,
+    phase_map,
+    phase_xml,
+    phase_count
+};
+
+char const* const phase_names[phase_count] = {
+    "read",
+    "parse",
+    "annotate",
+    "resolve",
+    "filters",
+    "map",
+    "xml"
+};
+
+struct phase_stats {
+    std::size_t runs;
+    double seconds;
+    std::size_t allocations;
+    std::size_t allocated_bytes;
+    long peak_rss_kb;
+
+    phase_stats()
+      : runs(0), seconds(0), allocations(0), allocated_bytes(0), peak_rss_kb(0) { }
+};
+
+long peak_rss_kb()
+{
+    struct rusage usage;
+    if (::getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    return usage.ru_maxrss;
+}
+
+// Adds the time and allocations between construction and stop() to the
+// stats of a phase. The peak RSS is the high-water mark of the process
+// when the phase ends.
+class phase_timer {
+
+public:
+    explicit phase_timer(phase_stats& stats_)
+      : stats(stats_),
+        start(boost::posix_time::microsec_clock::universal_time()),
+        start_allocations(allocations),
+        start_bytes(allocated_bytes) { }
+
+    void stop()
+    {
+        stats.seconds += (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+        stats.allocations += allocations - start_allocations;
+        stats.allocated_bytes += allocated_bytes - start_bytes;
+        stats.peak_rss_kb = std::max(stats.peak_rss_kb, peak_rss_kb());
+        ++stats.runs;
+    }
+
+private:
+    phase_stats& stats;
+    boost::posix_time::ptime start;
+    std::size_t start_allocations;
+    std::size_t start_bytes;
+};
+
+struct input {
+    std::string name;
+    std::string path;
+    std::string source;
+    std::size_t rules;
+};
+
+struct result {
+    std::string name;
+    std::size_t bytes;
+    phase_stats phases[phase_count];
+};
+
+// one selector per country code with a filter, a zoom range and a few
+// properties, roughly what our generated label stylesheets look like
+std::string synthetic_stylesheet(std::size_t rules)
+{
+    std::ostringstream out;
+
+    out << "@label: #333;\n";
+
+    for (std::size_t i = 0; i != rules; ++i) {
+        out << "#countries[code='C" << i << "'][zoom>=" << i % 10 << "] { "
+            << "text-name: '[name]'; "
+            << "text-size: " << 10 + i % 5 << "; "
+            << "text-fill: @label; }\n";
+    }
+
+    return out.str();
+}
+
+void add_inputs(std::string const& path, std::vector<input>& inputs)
+{
+    namespace fs = boost::filesystem;
+
+    std::vector<std::string> files;
+
+    if (fs::is_directory(path)) {
+        fs::recursive_directory_iterator it(path), end;
+
+        for (; it != end; ++it) {
+            std::string file = it->path().string();
+
+            if (fs::is_regular_file(it->path()) && boost::algorithm::ends_with(file, ".mss"))
+                files.push_back(file);
+        }
+
+        // directory order is not stable between machines
+        std::sort(files.begin(), files.end());
+    } else {
+        files.push_back(path);
+    }
+
+    for (std::size_t i = 0; i != files.size(); ++i) {
+        input in;
+        in.name  = files[i];
+        in.path  = files[i];
+        in.rules = 0;
+        inputs.push_back(in);
+    }
+}
+
+// every top level style has to come back with its type and location,
+// well past the 32767 nodes a 16 bit tag could index directly
+void check_styles(carto::parse_tree const& tree, input const& in)
+{
+    carto::utree const& root = tree.ast();
+
+    typedef carto::utree::const_iterator iter;
+    iter it  = root.begin(),
+         end = root.end();
+
+    std::size_t styles = 0;
+
+    for (; it != end; ++it) {
+        if (tree.annotations().type(*it) != CARTO_STYLE)
+            continue;
+
+        if (!tree.annotations().location(*it).valid())
+            throw carto::carto_error("Style without a location in " + in.name);
+
+        ++styles;
+    }
+
+    if (in.rules != 0 && styles != in.rules) {
+        std::ostringstream out;
+        out << "Expected " << in.rules << " styles in " << in.name << ", found " << styles;
+        throw carto::carto_error(out.str());
+    }
+}
+
+// builds the expression of every filter of the stylesheet outside of the
+// styles they belong to, with only the top level variables defined; the
+// filters that need a variable of their style fail and are left out
+void generate_filters(carto::parse_tree const& tree, carto::utree const& ut, carto::style_env const& env)
+{
+    typedef carto::utree::const_iterator iter;
+
+    if (tree.annotations().type(ut) == CARTO_FILTER) {
+        carto::zoom_table const zooms;
+
+        for (iter it = ut.begin(); it != ut.end(); ++it) {
+            carto::rule_builder rule;
+            carto::filter_printer printer(*it, tree.annotations(), env, rule, zooms);
+
+            try {
+                printer.generate();
+            } catch (carto::carto_error&) { }
+        }
+    } else if (ut.which() == boost::spirit::utree_type::list_type) {
+        for (iter it = ut.begin(); it != ut.end(); ++it)
+            generate_filters(tree, *it, env);
+    }
+}
+
+// Runs every phase of compiling one stylesheet to XML repeat times. The
+// phases see the output of the ones before them but are timed apart:
+//
+//   read      loading the file into memory
+//   parse     the Spirit grammar, including the line index of the source
+//   annotate  finalizing the annotations of the parse tree
+//   resolve   folding constant expressions and top level variables
+//   filters   building the mapnik expression of every filter on its own
+//   map       building the mapnik::Map, which resolves variables and
+//             builds the filters again as part of the styles
+//   xml       serializing the map
+void run(input const& in, std::size_t repeat, result& res)
+{
+    typedef carto::position_iterator<char const*> iter;
+
+    res.name = in.name;
+
+    for (std::size_t r = 0; r != repeat; ++r) {
+        std::string source;
+
+        if (in.path.empty()) {
+            source = in.source;
+        } else {
+            phase_timer timer(res.phases[phase_read]);
+            carto::mapped_file file(in.path);
+            source.assign(file.begin(), file.end());
+            timer.stop();
+        }
+
+        res.bytes = source.size();
+
+        carto::parse_tree tree;
+
+        {
+            phase_timer timer(res.phases[phase_parse]);
+
+            tree.annotations().reserve(carto::annotations_type::estimate(source.size()));
+            tree.annotations().set_lines(boost::make_shared<carto::line_index>(source.data(), source.data() + source.size()));
+
+            carto::carto_parser<iter> parser(in.name, tree.annotations());
+
+            iter it(source.data()),
+                 end(source.data() + source.size());
+
+            if (!boost::spirit::qi::phrase_parse(it, end, parser, carto::whitespace, tree.ast()))
+                throw carto::carto_error("Parser failed!");
+
+            timer.stop();
+        }
+
+        {
+            phase_timer timer(res.phases[phase_annotate]);
+            tree.annotations().finalize(tree.ast());
+            timer.stop();
+        }
+
+        if (r == 0)
+            check_styles(tree, in);
+
+        {
+            phase_timer timer(res.phases[phase_resolve]);
+            carto::fold_constants(tree);
+            timer.stop();
+        }
+
+        mapnik::Map map(800, 600);
+        carto::mss_parser parser(tree, in.name, false);
+
+        {
+            phase_timer timer(res.phases[phase_map]);
+            carto::style_env env;
+            parser.parse(map, env);
+            timer.stop();
+        }
+
+        {
+            mapnik::Map scratch(800, 600);
+            carto::style_env env;
+            parser.parse_definitions(scratch, env);
+
+            phase_timer timer(res.phases[phase_filters]);
+            generate_filters(tree, tree.ast(), env);
+            timer.stop();
+        }
+
+        {
+            phase_timer timer(res.phases[phase_xml]);
+            std::string xml = mapnik::save_map_to_string(map, false);
+            timer.stop();
+        }
+    }
+}
+
+std::string json_string(std::string const& str)
+{
+    std::ostringstream out;
+    out << '"';
+
+    for (std::size_t i = 0; i != str.size(); ++i) {
+        unsigned char c = str[i];
+
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        else
+            out << c;
+    }
+
+    out << '"';
+    return out.str();
+}
+
+double throughput(std::size_t bytes, phase_stats const& stats)
+{
+    return stats.seconds > 0 ? bytes * double(stats.runs) / stats.seconds / (1024 * 1024) : 0;
+}
+
+void print_text(std::vector<result> const& results)
+{
+    std::cout << std::left  << std::setw(48) << "input"
+              << std::setw(10) << "phase"
+              << std::right << std::setw(12) << "s/run"
+              << std::setw(12) << "MB/s"
+              << std::setw(14) << "allocs/run"
+              << std::setw(14) << "KB alloc/run"
+              << std::setw(14) << "peak RSS KB" << "\n";
+
+    for (std::size_t i = 0; i != results.size(); ++i) {
+        for (int p = 0; p != phase_count; ++p) {
+            phase_stats const& stats = results[i].phases[p];
+
+            if (stats.runs == 0)
+                continue;
+
+            std::cout << std::left  << std::setw(48) << results[i].name
+                      << std::setw(10) << phase_names[p]
+                      << std::right << std::setw(12) << stats.seconds / stats.runs
+                      << std::setw(12) << throughput(results[i].bytes, stats)
+                      << std::setw(14) << stats.allocations / stats.runs
+                      << std::setw(14) << stats.allocated_bytes / stats.runs / 1024
+                      << std::setw(14) << stats.peak_rss_kb << "\n";
+        }
+    }
+}
+
+// one object per input and phase, averaged over the runs
+void print_json(std::vector<result> const& results, std::size_t repeat)
+{
+    std::cout << "{\n  \"repeat\": " << repeat << ",\n  \"results\": [";
+
+    bool first = true;
+
+    for (std::size_t i = 0; i != results.size(); ++i) {
+        for (int p = 0; p != phase_count; ++p) {
+            phase_stats const& stats = results[i].phases[p];
+
+            if (stats.runs == 0)
+                continue;
+
+            std::cout << (first ? "\n" : ",\n")
+                      << "    {\"input\": " << json_string(results[i].name)
+                      << ", \"phase\": \"" << phase_names[p] << "\""
+                      << ", \"bytes\": " << results[i].bytes
+                      << ", \"runs\": " << stats.runs
+                      << ", \"seconds\": " << stats.seconds / stats.runs
+                      << ", \"throughput_mb_s\": " << throughput(results[i].bytes, stats)
+                      << ", \"allocations\": " << stats.allocations / stats.runs
+                      << ", \"allocated_bytes\": " << stats.allocated_bytes / stats.runs
+                      << ", \"peak_rss_kb\": " << stats.peak_rss_kb << "}";
+
+            first = false;
+        }
+    }
+
+    std::cout << "\n  ]\n}\n";
+}
+
+}
+
+#if __cplusplus >= 201103L
+#define BENCH_THROW_BAD_ALLOC
+#define BENCH_NOTHROW noexcept
+#else
+#define BENCH_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define BENCH_NOTHROW throw()
+#endif
+
+void* operator new(std::size_t size) BENCH_THROW_BAD_ALLOC
+{
+    ++allocations;
+    allocated_bytes += size;
+
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) BENCH_NOTHROW
+{
+    std::free(p);
+}
+
+int main(int argc, char **argv) {
+
+    namespace po = boost::program_options;
+
+    std::size_t repeat;
+    std::vector<std::size_t> rules;
+    std::vector<std::string> paths;
+    std::string format;
+
+    po::options_description desc("bench");
+    desc.add_options()
+        ("help,h", "produce this usage message")
+        ("input,i", po::value< std::vector<std::string> >(&paths), "stylesheet, or directory searched for stylesheets (default: tests)")
+        ("rules", po::value< std::vector<std::size_t> >(&rules), "also compile a synthetic stylesheet with this many rules (default: 1000 and 50000)")
+        ("repeat", po::value<std::size_t>(&repeat)->default_value(5), "number of times to compile each input")
+        ("format", po::value<std::string>(&format)->default_value("text"), "text or json");
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help") || (format != "text" && format != "json"))
+    {
+        std::cout << desc << "\nusage: bench [--input path]... [--rules n]... [--repeat n] [--format text|json]" << std::endl;
+        return 1;
+    }
+
+    if (paths.empty() && rules.empty()) {
+        paths.push_back("tests");
+        rules.push_back(1000);
+        rules.push_back(50000);
+    }
+
+    std::vector<input> inputs;
+
+    try {
+        for (std::size_t i = 0; i != paths.size(); ++i)
+            add_inputs(paths[i], inputs);
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    for (std::size_t i = 0; i != rules.size(); ++i) {
+        input in;
+        std::ostringstream name;
+        name << "synthetic-" << rules[i];
+
+        in.name   = name.str();
+        in.source = synthetic_stylesheet(rules[i]);
+        in.rules  = rules[i];
+        inputs.push_back(in);
+    }
+
+    // warnings would be repeated for every run of every input
+    std::streambuf* clog_buf = std::clog.rdbuf(0);
+
+    std::vector<result> results;
+    bool failed = false;
+
+    for (std::size_t i = 0; i != inputs.size(); ++i) {
+        result res;
+
+        try {
+            run(inputs[i], repeat ? repeat : 1, res);
+            results.push_back(res);
+        } catch (std::exception& e) {
+            std::cerr << "Skipping " << inputs[i].name << ": " << e.what() << "\n";
+
+            // the synthetic stylesheets are ours and have to compile
+            failed = failed || inputs[i].path.empty();
+        }
+    }
+
+    std::clog.rdbuf(clog_buf);
+
+    if (format == "json")
+        print_json(results, repeat ? repeat : 1);
+    else
+        print_text(results);
+
+    return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,217 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <parse/carto_grammar.hpp>
+#include <parse/parse_tree.hpp>
+#include <utility/mapped_file.hpp>
+
+namespace {
+
+namespace qi = boost::spirit::qi;
+
+typedef carto::position_iterator<char const*> iter;
+typedef carto::carto_parser<iter> parser_type;
+
+// one attribute of every kind of value per rule, expressions included
+std::string synthetic_stylesheet(std::size_t rules)
+{
+    std::ostringstream out;
+
+    out << "@fill: #8ac;\n";
+
+    for (std::size_t i = 0; i != rules; ++i) {
+        out << "#layer" << i << " { "
+            << "line-width: " << 1 + i % 4 << "; "
+            << "line-color: #" << 100 + i % 900 << "; "
+            << "polygon-fill: @fill; "
+            << "line-cap: round; "
+            << "text-face-name: 'DejaVu Sans Book'; "
+            << "line-dasharray: 4, 2; "
+            << "text-size: @size * 2 + " << i % 7 << "; "
+            << "line-join: miter; }\n";
+    }
+
+    return out.str();
+}
+
+struct rule_counter {
+    std::size_t& calls;
+
+    rule_counter(std::size_t& calls_)
+      : calls(calls_) { }
+
+    template<class Context, class State>
+    void operator() (iter const&, iter const&, Context const&, State state, std::string const&) const
+    {
+        if (state == qi::pre_parse)
+            ++calls;
+    }
+};
+
+template<class Rule>
+void count_calls(Rule& rule, std::size_t& calls)
+{
+    qi::debug(rule, rule_counter(calls));
+}
+
+// the value rule before it dispatched on the first character, for
+// comparison
+void use_ordered_values(parser_type& p)
+{
+    using qi::double_;
+    using qi::bool_;
+
+    p.value =   ( p.null          >> ";" )
+              | ( p.color         >> ";" )
+              | ( double_ % ","   >> ";" )
+              | ( bool_           >> ";" )
+              | ( p.var_val       >> ";" )
+              | ( p.ustring % "," >> ";" )
+              | ( p.expr_val      >> ";" )
+              | ( p.enum_val      >> ";" );
+}
+
+// every rule a value can try below the value rule itself, in the 
+// stylesheet and the expression grammar
+void count_value_rules(parser_type& p, std::size_t& values, std::size_t& calls)
+{
+    count_calls(p.value, values);
+    count_calls(p.number_value, calls);
+    count_calls(p.color_value, calls);
+    count_calls(p.var_value, calls);
+    count_calls(p.string_value, calls);
+    count_calls(p.word_value, calls);
+    count_calls(p.null, calls);
+    count_calls(p.color, calls);
+    count_calls(p.var_val, calls);
+    count_calls(p.var_name, calls);
+    count_calls(p.ustring, calls);
+    count_calls(p.expr_val, calls);
+    count_calls(p.expression, calls);
+    count_calls(p.enum_val, calls);
+
+    count_calls(p.expression_text.expression, calls);
+    count_calls(p.expression_text.term, calls);
+    count_calls(p.expression_text.factor, calls);
+    count_calls(p.expression_text.function, calls);
+    count_calls(p.expression_text.name, calls);
+    count_calls(p.expression_text.var_name, calls);
+    count_calls(p.expression_text.ustring, calls);
+}
+
+struct run_result {
+    std::size_t values;
+    std::size_t calls;
+    double seconds;
+};
+
+run_result run(std::string const& source, std::string const& path, bool ordered, std::size_t repeat)
+{
+    run_result result;
+    result.values = 0;
+    result.calls = 0;
+
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+    for (std::size_t i = 0; i != repeat; ++i) {
+        carto::parse_tree tree;
+
+        parser_type p(path, tree.annotations());
+
+        if (ordered)
+            use_ordered_values(p);
+
+        std::size_t values = 0, calls = 0;
+        count_value_rules(p, values, calls);
+
+        iter it(source.data()),
+             end(source.data() + source.size());
+
+        if (!qi::phrase_parse(it, end, p, carto::whitespace, tree.ast()) || it != end)
+            throw carto::carto_error("Parser failed!");
+
+        tree.annotations().finalize(tree.ast());
+
+        result.values = values;
+        result.calls = calls;
+    }
+
+    result.seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6 / repeat;
+
+    return result;
+}
+
+void report(std::string const& name, run_result const& r)
+{
+    std::cout << name << ": "
+              << r.calls << " rule calls, "
+              << double(r.calls) / r.values << " per attribute, "
+              << r.seconds << " s per parse\n";
+}
+
+}
+
+// Counts the grammar rules tried while parsing attribute values, with the
+// value rule that dispatches on the first character and with the ordered
+// list of alternatives it replaced. Every rule is counted through a debug
+// handler, which also makes the parse slower than a plain one.
+int main(int argc, char **argv) {
+
+    namespace po = boost::program_options;
+
+    std::size_t rules, repeat;
+    std::string input;
+
+    po::options_description desc("value_bench");
+    desc.add_options()
+        ("help,h", "produce this usage message")
+        ("rules", po::value<std::size_t>(&rules)->default_value(10000), "number of rules in the synthetic stylesheet")
+        ("input,i", po::value<std::string>(&input), "parse this stylesheet instead of a synthetic one")
+        ("repeat", po::value<std::size_t>(&repeat)->default_value(5), "number of times to parse the input");
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << desc << "\nusage: value_bench [--rules n] [--input file.mss] [--repeat n]" << std::endl;
+        return 1;
+    }
+
+    try {
+        std::string source, path = "synthetic.mss";
+
+        if (input.empty()) {
+            source = synthetic_stylesheet(rules);
+        } else {
+            carto::mapped_file file(input);
+            source.assign(file.begin(), file.end());
+            path = input;
+        }
+
+        repeat = repeat ? repeat : 1;
+
+        run_result ordered  = run(source, path, true, repeat),
+                   dispatch = run(source, path, false, repeat);
+
+        std::cout << "bytes:      " << source.size() << "\n"
+                  << "attributes: " << dispatch.values << "\n";
+
+        report("ordered ", ordered);
+        report("dispatch", dispatch);
+
+        std::cout << "rule calls saved: "
+                  << 100.0 * (1.0 - double(dispatch.calls) / ordered.calls) << "%\n";
+
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}